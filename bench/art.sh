@@ -0,0 +1,71 @@
+#!/bin/sh
+# Album art check: a local HTTP server on a non-default port serves a cover
+# that the mock player advertises with a fragment, check-art loads it
+# through src/art.c. The server rejects a Host header without the port and
+# a path with the fragment, so either one fails the check as well as
+# a thumbnail missing from the disk cache.
+# Tunables (environment): BUILDDIR of the mock player and check-art,
+# PORT of the HTTP server.
+
+BUILDDIR=${BUILDDIR:-.}
+PORT=${PORT:-8765}
+
+# Run on a private bus, away from the real player
+if [ -z "$ART_PRIVATE_BUS" ]; then
+	export ART_PRIVATE_BUS=1
+	exec dbus-run-session -- sh "$0" "$@"
+fi
+
+tmp=$(mktemp -d)
+python3 - "$PORT" <<'EOF' &
+import http.server, struct, sys, zlib
+
+port = int(sys.argv[1])
+
+def chunk(kind, data):
+    return (struct.pack('>I', len(data)) + kind + data +
+            struct.pack('>I', zlib.crc32(kind + data)))
+
+def png(width, height):
+    rows = b''.join(b'\0' + b'\x1d\xb9\x54' * width for _ in range(height))
+    return (b'\x89PNG\r\n\x1a\n' +
+            chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)) +
+            chunk(b'IDAT', zlib.compress(rows)) + chunk(b'IEND', b''))
+
+cover = png(640, 480)
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    def do_GET(self):
+        host = self.headers.get('Host')
+        if host != '127.0.0.1:%d' % port or self.path != '/cover.png':
+            self.send_error(400, 'Unexpected Host %s or path %s' %
+                            (host, self.path))
+            return
+        self.send_response(200)
+        self.send_header('Content-Type', 'image/png')
+        self.send_header('Content-Length', str(len(cover)))
+        self.end_headers()
+        self.wfile.write(cover)
+
+http.server.HTTPServer(('127.0.0.1', port), Handler).serve_forever()
+EOF
+server_pid=$!
+"$BUILDDIR/mock-player" --rate 0 \
+	--art-url "http://127.0.0.1:$PORT/cover.png#front" &
+mock_pid=$!
+sleep 1
+XDG_CACHE_HOME="$tmp" "$BUILDDIR/check-art"
+status=$?
+if [ $status -eq 0 ] && ! ls "$tmp"/spotify-tray/art/*.png >/dev/null 2>&1; then
+	echo "The thumbnail is not in the disk cache" >&2
+	status=1
+fi
+kill $server_pid $mock_pid
+wait 2>/dev/null
+rm -rf "$tmp"
+
+if [ $status -ne 0 ]; then
+	echo "FAIL" >&2
+	exit 1
+fi
+echo "PASS"
@@ -0,0 +1,148 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <stdlib.h>
+#include <gio/gio.h>
+#include "proxy.h"
+#include "metadata.h"
+
+/* Microbenchmark of the metadata decoder: decodes and frees synthetic
+ * Metadata dictionaries and reports the time and heap allocations per
+ * update. */
+
+#define DEFAULT_ITERATIONS 100000
+
+/* Count the heap allocations by interposing the libc allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static guint64 allocations = 0;
+
+void *malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocations++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+struct _bench_case_s {
+	const gchar *name;
+	gint title_length;
+	gint artists;
+	const gchar *artist; /* name of every artist */
+};
+
+typedef struct _bench_case_s bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+	{ "short", 16, 1, "Artist" },
+	{ "long-title", 512, 1, "Artist" },
+	{ "many-artists", 32, 64, "Artist" },
+	{ "unicode", 128, 8,
+		"\xc3\x81rt\xc3\xadst \xe2\x99\xab \xe6\x97\xa5\xe6\x9c\xac" },
+	{ NULL }
+};
+
+static GVariant *new_metadata(const bench_case_t *bench_case)
+{
+	GVariantBuilder builder, artists;
+	GVariant *built, *serialized;
+	GString *title;
+	gint i, j;
+
+	title = g_string_new(NULL);
+	while (title->len < bench_case->title_length)
+		g_string_append(title, bench_case->artist);
+	g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&builder, "{sv}", "mpris:trackid",
+			g_variant_new_string("spotify:track:4uLU6hMCjMI75M1A2tKUQC"));
+	g_variant_builder_add(&builder, "{sv}", "mpris:length",
+			g_variant_new_uint64(215000000));
+	g_variant_builder_add(&builder, "{sv}", "mpris:artUrl",
+			g_variant_new_string("https://i.scdn.co/image/ab67616d0000b273"));
+	g_variant_builder_add(&builder, "{sv}", "xesam:album",
+			g_variant_new_string(title->str));
+	for (j = 0; j < 2; j++) {
+		g_variant_builder_init(&artists, G_VARIANT_TYPE_STRING_ARRAY);
+		for (i = 0; i < bench_case->artists; i++)
+			g_variant_builder_add(&artists, "s", bench_case->artist);
+		g_variant_builder_add(&builder, "{sv}",
+				j ? "xesam:artist" : "xesam:albumArtist",
+				g_variant_builder_end(&artists));
+	}
+	g_variant_builder_add(&builder, "{sv}", "xesam:autoRating",
+			g_variant_new_double(0.42));
+	g_variant_builder_add(&builder, "{sv}", "xesam:discNumber",
+			g_variant_new_int32(1));
+	g_variant_builder_add(&builder, "{sv}", "xesam:title",
+			g_variant_new_string(title->str));
+	g_variant_builder_add(&builder, "{sv}", "xesam:trackNumber",
+			g_variant_new_int32(7));
+	g_variant_builder_add(&builder, "{sv}", "xesam:url",
+			g_variant_new_string("https://open.spotify.com/track/4uLU6hMCjMI"));
+	g_string_free(title, TRUE);
+
+	/* Serialize it as if it came from the bus */
+	built = g_variant_ref_sink(g_variant_builder_end(&builder));
+	serialized = g_variant_get_normal_form(built);
+	g_variant_unref(built);
+
+	return serialized;
+}
+
+static void run_case(const bench_case_t *bench_case, gint iterations)
+{
+	proxy_metadata_t metadata = { NULL };
+	GVariant *dict;
+	guint64 allocs_start;
+	gint64 time_start, time_total;
+	gint i;
+
+	dict = new_metadata(bench_case);
+	/* Warm up */
+	metadata_update(&metadata, dict, TRUE);
+	metadata_free_values(&metadata);
+
+	allocs_start = allocations;
+	time_start = g_get_monotonic_time();
+	for (i = 0; i < iterations; i++) {
+		metadata_update(&metadata, dict, TRUE);
+		metadata_free_values(&metadata);
+	}
+	time_total = g_get_monotonic_time() - time_start;
+
+	g_print("%-14s %8.0f ns/op %8.1f allocs/op (%" G_GSIZE_FORMAT
+			" bytes serialized)\n",
+			bench_case->name,
+			time_total * 1000.0 / iterations,
+			(gdouble) (allocations - allocs_start) / iterations,
+			g_variant_get_size(dict));
+	g_variant_unref(dict);
+}
+
+int main(int argc, char **argv)
+{
+	gint iterations = DEFAULT_ITERATIONS;
+	const bench_case_t *bench_case;
+
+	if (argc > 1)
+		iterations = MAX(atoi(argv[1]), 1);
+	g_print("%d iterations of metadata update + free\n", iterations);
+	for (bench_case = bench_cases; bench_case->name != NULL; bench_case++)
+		run_case(bench_case, iterations);
+
+	return 0;
+}
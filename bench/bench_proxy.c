@@ -0,0 +1,213 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <string.h>
+#include <sys/resource.h>
+#include <gtk/gtk.h>
+#include "proxy.h"
+#include "stats.h"
+
+/* Drives proxy.c against the mock player: starts the signal storm, waits
+ * for the given number of track changes measuring the latency of each of
+ * them, then measures the round trip of queued method calls. Reports the
+ * process CPU time and peak RSS at the end. */
+
+#define BENCH_SERVICE_NAME "org.mpris.MediaPlayer2.spotify"
+#define BENCH_PLAYER_INTERFACE "org.mpris.MediaPlayer2.Player"
+#define BENCH_TRACK_ID_PREFIX "spotify:track:bench:"
+
+struct _bench_s {
+	GMainLoop *loop;
+	proxy_t *proxy;
+	gint signals; /* track changes to wait for */
+	gint calls; /* method calls to measure */
+	GArray *signal_latency; /* gint64 usec */
+	GArray *call_latency; /* gint64 usec */
+	guint64 notifications;
+	gint64 call_start;
+	gint call_failures;
+	gboolean started;
+	gboolean failed;
+};
+
+typedef struct _bench_s bench_t;
+
+static gint compare_int64(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a;
+	gint64 y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+static gint64 percentile(GArray *samples, gdouble p)
+{
+	if (samples->len == 0)
+		return 0;
+	return g_array_index(samples, gint64,
+			MIN((guint) (p * samples->len), samples->len - 1));
+}
+
+static void report_samples(const gchar *name, GArray *samples)
+{
+	g_array_sort(samples, compare_int64);
+	g_print("%-16s n=%-6u p50=%-6" G_GINT64_FORMAT " p90=%-6" G_GINT64_FORMAT
+			" p99=%-6" G_GINT64_FORMAT " max=%-6" G_GINT64_FORMAT " (usec)\n",
+			name, samples->len,
+			percentile(samples, 0.5), percentile(samples, 0.9),
+			percentile(samples, 0.99), percentile(samples, 1.0));
+}
+
+static void report(bench_t *bench)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	g_print("notifications    %" G_GUINT64_FORMAT "\n", bench->notifications);
+	report_samples("signal latency", bench->signal_latency);
+	report_samples("call round trip", bench->call_latency);
+	g_print("call failures    %d\n", bench->call_failures);
+	g_print("signals          %" G_GUINT64_FORMAT "\n", stats_get(STATS_SIGNALS));
+	g_print("metadata parses  %" G_GUINT64_FORMAT "\n",
+			stats_get(STATS_METADATA_PARSES));
+	g_print("loop wakeups     %" G_GUINT64_FORMAT ", stalls %" G_GUINT64_FORMAT
+			"\n", stats_get(STATS_LOOP_WAKEUPS), stats_get(STATS_LOOP_STALLS));
+	g_print("cpu time         user %ld.%06ld s, system %ld.%06ld s\n",
+			(long) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec,
+			(long) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec);
+	g_print("peak rss         %ld kB\n", usage.ru_maxrss);
+}
+
+static void on_call_done(proxy_t *proxy, const gchar *method,
+		const GError *error, gpointer user_data)
+{
+	bench_t *bench = user_data;
+	gint64 latency = g_get_monotonic_time() - bench->call_start;
+
+	/* The proxy is being freed */
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		return;
+	if (error)
+		bench->call_failures++;
+	else
+		g_array_append_val(bench->call_latency, latency);
+	if (bench->call_latency->len + bench->call_failures >= bench->calls) {
+		g_main_loop_quit(bench->loop);
+		return;
+	}
+	bench->call_start = g_get_monotonic_time();
+	proxy_method_call(proxy, BENCH_PLAYER_INTERFACE, "PlayPause", NULL,
+			on_call_done, bench);
+}
+
+static void on_proxy_changed(proxy_t *proxy, guint changes,
+		gpointer user_data)
+{
+	bench_t *bench = user_data;
+	const gchar *track_id;
+	gint64 sent, latency;
+
+	if (!bench->started) {
+		if (!proxy->active)
+			return;
+		/* The player registry knows the mock: start the signal storm */
+		bench->started = TRUE;
+		proxy_simple_method_call(proxy, PROXY_CALL_PLAY);
+		return;
+	}
+	bench->notifications++;
+	if (!(changes & PROXY_CHANGED_METADATA) || !proxy->metadata->track_id)
+		return;
+	track_id = proxy->metadata->track_id;
+	if (!g_str_has_prefix(track_id, BENCH_TRACK_ID_PREFIX))
+		return;
+	sent = g_ascii_strtoll(track_id + strlen(BENCH_TRACK_ID_PREFIX), NULL, 10);
+	latency = g_get_monotonic_time() - sent;
+	g_array_append_val(bench->signal_latency, latency);
+	if (bench->signal_latency->len == bench->signals) {
+		/* All the signals are in, measure the method calls */
+		if (bench->calls <= 0) {
+			g_main_loop_quit(bench->loop);
+			return;
+		}
+		bench->call_start = g_get_monotonic_time();
+		proxy_method_call(proxy, BENCH_PLAYER_INTERFACE, "PlayPause", NULL,
+				on_call_done, bench);
+	}
+}
+
+static void on_player_appeared(GDBusConnection *connection,
+		const gchar *name, const gchar *name_owner, gpointer user_data)
+{
+	bench_t *bench = user_data;
+
+	if (bench->proxy)
+		return;
+	if (!(bench->proxy = proxy_new_proxy(0, NULL))) {
+		bench->failed = TRUE;
+		g_main_loop_quit(bench->loop);
+		return;
+	}
+	proxy_add_changed_func(bench->proxy, on_proxy_changed, bench);
+}
+
+static gboolean on_timeout(gpointer user_data)
+{
+	bench_t *bench = user_data;
+
+	g_critical("Timed out");
+	bench->failed = TRUE;
+	g_main_loop_quit(bench->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char **argv)
+{
+	bench_t bench = { NULL, NULL, 1000, 200, NULL, NULL, 0, 0, 0, FALSE };
+	gint timeout = 60;
+	GOptionEntry entries[] = {
+		{"signals", 's', 0, G_OPTION_ARG_INT, &bench.signals,
+			"Track changes to wait for, default 1000", "<n>"},
+		{"calls", 'c', 0, G_OPTION_ARG_INT, &bench.calls,
+			"Method call round trips to measure, default 200", "<n>"},
+		{"timeout", 't', 0, G_OPTION_ARG_INT, &timeout,
+			"Give up after the given number of seconds, default 60", "<sec>"},
+		{NULL}
+	};
+	GOptionContext *context;
+	GError *err = NULL;
+	guint watch_id;
+
+	context = g_option_context_new("- proxy benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	stats_monitor_main_loop();
+	bench.loop = g_main_loop_new(NULL, FALSE);
+	bench.signal_latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	bench.call_latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	watch_id = g_bus_watch_name(G_BUS_TYPE_SESSION,
+			BENCH_SERVICE_NAME,
+			G_BUS_NAME_WATCHER_FLAGS_NONE,
+			on_player_appeared,
+			NULL, /* name vanished */
+			&bench, /* user data */
+			NULL); /* user data free func */
+	g_timeout_add_seconds(timeout, on_timeout, &bench);
+	g_main_loop_run(bench.loop);
+	g_bus_unwatch_name(watch_id);
+
+	report(&bench);
+	proxy_free_proxy(bench.proxy);
+	g_array_free(bench.signal_latency, TRUE);
+	g_array_free(bench.call_latency, TRUE);
+	g_main_loop_unref(bench.loop);
+
+	return bench.failed ? 1 : 0;
+}
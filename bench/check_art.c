@@ -0,0 +1,127 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include "proxy.h"
+#include "art.h"
+
+/* Loads the album art the mock player advertises through art.c, the way
+ * the tooltip does, and checks the thumbnail fits the requested size. */
+
+#define CHECK_SERVICE_NAME "org.mpris.MediaPlayer2.spotify"
+#define CHECK_POLL_INTERVAL 100 /* msec */
+
+struct _check_s {
+	GMainLoop *loop;
+	proxy_t *proxy;
+	art_cache_t *cache;
+	gint size;
+	gchar *url;
+	gboolean failed;
+};
+
+typedef struct _check_s check_t;
+
+/* art.c has no completion callback: the tooltip just looks it up */
+static gboolean on_poll(gpointer user_data)
+{
+	check_t *check = user_data;
+	GdkPixbuf *pixbuf = art_cache_lookup(check->cache, check->url);
+
+	if (!pixbuf)
+		return G_SOURCE_CONTINUE;
+	g_print("%s: %dx%d\n", check->url, gdk_pixbuf_get_width(pixbuf),
+			gdk_pixbuf_get_height(pixbuf));
+	if (gdk_pixbuf_get_width(pixbuf) > check->size ||
+			gdk_pixbuf_get_height(pixbuf) > check->size) {
+		g_critical("The thumbnail is larger than %d px", check->size);
+		check->failed = TRUE;
+	}
+	g_main_loop_quit(check->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void on_proxy_changed(proxy_t *proxy, guint changes,
+		gpointer user_data)
+{
+	check_t *check = user_data;
+
+	if (check->url || !(changes & PROXY_CHANGED_METADATA) ||
+			!proxy->metadata->art_url)
+		return;
+	check->url = g_strdup(proxy->metadata->art_url);
+	art_cache_fetch(check->cache, check->url);
+	g_timeout_add(CHECK_POLL_INTERVAL, on_poll, check);
+}
+
+static void on_player_appeared(GDBusConnection *connection,
+		const gchar *name, const gchar *name_owner, gpointer user_data)
+{
+	check_t *check = user_data;
+
+	if (check->proxy)
+		return;
+	if (!(check->proxy = proxy_new_proxy(0, NULL))) {
+		check->failed = TRUE;
+		g_main_loop_quit(check->loop);
+		return;
+	}
+	proxy_add_changed_func(check->proxy, on_proxy_changed, check);
+}
+
+static gboolean on_timeout(gpointer user_data)
+{
+	check_t *check = user_data;
+
+	g_critical("Timed out");
+	check->failed = TRUE;
+	g_main_loop_quit(check->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char **argv)
+{
+	check_t check = { NULL, NULL, NULL, 64, NULL, FALSE };
+	gint timeout = 15;
+	GOptionEntry entries[] = {
+		{"size", 's', 0, G_OPTION_ARG_INT, &check.size,
+			"Thumbnail size, default 64", "<px>"},
+		{"timeout", 't', 0, G_OPTION_ARG_INT, &timeout,
+			"Give up after the given number of seconds, default 15", "<sec>"},
+		{NULL}
+	};
+	GOptionContext *context;
+	GError *err = NULL;
+	guint watch_id;
+
+	context = g_option_context_new("- album art check");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	check.loop = g_main_loop_new(NULL, FALSE);
+	check.cache = art_cache_new(check.size);
+	watch_id = g_bus_watch_name(G_BUS_TYPE_SESSION,
+			CHECK_SERVICE_NAME,
+			G_BUS_NAME_WATCHER_FLAGS_NONE,
+			on_player_appeared,
+			NULL, /* name vanished */
+			&check, /* user data */
+			NULL); /* user data free func */
+	g_timeout_add_seconds(timeout, on_timeout, &check);
+	g_main_loop_run(check.loop);
+	g_bus_unwatch_name(watch_id);
+
+	proxy_free_proxy(check.proxy);
+	art_cache_free(check.cache);
+	g_free(check.url);
+	g_main_loop_unref(check.loop);
+
+	return check.failed ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# spotify-tray-ctl check: runs the commands on a private session bus with
+# no tray and reads the calls they send with dbus-monitor, so no display is
+# needed. A negative seek has to reach the tray as a negative offset, both
+# alone and within a batch.
+# Tunables (environment): CTL the binary.
+
+CTL=${CTL:-../src/spotify-tray-ctl}
+
+# Run on a private bus, away from the real tray
+if [ -z "$CTL_PRIVATE_BUS" ]; then
+	export CTL_PRIVATE_BUS=1
+	exec dbus-run-session -- sh "$0" "$@"
+fi
+
+log=$(mktemp)
+dbus-monitor --session \
+	"type='method_call',interface='name.smetana.SpotifyTray'" > "$log" &
+monitor_pid=$!
+sleep 1
+# Nothing answers: the calls fail, only what was sent matters
+"$CTL" seek -10 2>/dev/null
+"$CTL" next seek -10 2>/dev/null
+sleep 1
+kill $monitor_pid
+wait 2>/dev/null
+
+# Prints the int64 arguments of the given method's call
+int64_args() {
+	awk -v member="member=$1" '
+		/^method call / { call = index($0, member) > 0 }
+		call && /int64/ { print $NF }' "$log"
+}
+
+status=0
+seek=$(int64_args Seek)
+batch=$(int64_args ExecuteBatch)
+rm -f "$log"
+echo "seek -10: Seek x=${seek:-none}, ExecuteBatch x=${batch:-none}"
+if [ "$seek" != "-10000000" ]; then
+	echo "FAIL: seek -10 did not send Seek(-10000000)" >&2
+	status=1
+fi
+if [ "$batch" != "-10000000" ]; then
+	echo "FAIL: next seek -10 did not batch Seek(-10000000)" >&2
+	status=1
+fi
+[ $status -eq 0 ] && echo "PASS"
+exit $status
@@ -0,0 +1,66 @@
+#!/bin/sh
+# Compares the memory footprint and the idle wakeups of the full tray and
+# the headless mode. Runs both against a quiet mock player on a private
+# session bus, so the numbers don't depend on the real client. Needs an X
+# session with a window manager, the mock player shows a window passing
+# for the Spotify client.
+# Tunables (environment): TRAY the binary, BUILDDIR of the mock player,
+# SETTLE seconds to wait after the start, IDLE seconds to measure over.
+
+TRAY=${TRAY:-../src/spotify-tray}
+BUILDDIR=${BUILDDIR:-.}
+SETTLE=${SETTLE:-3}
+IDLE=${IDLE:-30}
+
+# Run on a private bus, away from the real player and tray
+if [ -z "$FOOTPRINT_PRIVATE_BUS" ]; then
+	export FOOTPRINT_PRIVATE_BUS=1
+	exec dbus-run-session -- sh "$0" "$@"
+fi
+
+# Sums the voluntary and involuntary context switches of all the threads
+ctxt_switches() {
+	cat /proc/$1/task/*/status 2>/dev/null | awk '
+		/^(non)?voluntary_ctxt_switches:/ { n += $2 }
+		END { print n + 0 }'
+}
+
+loop_wakeups() {
+	gdbus call --session --dest name.smetana.SpotifyTray \
+		--object-path /name/smetana/SpotifyTray \
+		--method org.freedesktop.DBus.Properties.Get \
+		name.smetana.SpotifyTray LoopWakeups 2>/dev/null |
+		sed -n 's/.*uint64 \([0-9]*\).*/\1/p'
+}
+
+measure() {
+	"$TRAY" --client-path=false --client-timeout=5 "$@" &
+	pid=$!
+	sleep "$SETTLE"
+	if ! kill -0 $pid 2>/dev/null; then
+		echo "spotify-tray $* did not start" >&2
+		return 1
+	fi
+	ctxt=$(ctxt_switches $pid)
+	wakeups=$(loop_wakeups)
+	sleep "$IDLE"
+	ctxt=$(($(ctxt_switches $pid) - ctxt))
+	# Every reading wakes the tray: only the last one counts in
+	wakeups=$(($(loop_wakeups) - ${wakeups:-0} - 1))
+	rss=$(awk '/^VmRSS:/ { print $2 }' /proc/$pid/status)
+	pss=$(awk '/^Pss:/ { print $2 }' /proc/$pid/smaps_rollup 2>/dev/null)
+	kill $pid
+	wait $pid 2>/dev/null
+	printf '%-12s rss=%6s kB pss=%6s kB ctxt_switches=%5s loop_wakeups=%5s' \
+		"${1:-full}" "$rss" "${pss:--}" "$ctxt" "$wakeups"
+	echo " (over ${IDLE} s)"
+}
+
+"$BUILDDIR/mock-player" --rate 0 --window &
+mock_pid=$!
+sleep 1
+status=0
+measure && measure --headless || status=1
+kill $mock_pid
+wait 2>/dev/null
+exit $status
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Idle wakeup test: runs the tray against a quiet mock player on a private
+# session bus and fails if its main loop wakes up more than MAX_WAKEUPS
+# times over IDLE seconds. Needs an X session with a window manager, the
+# mock player shows a window passing for the Spotify client.
+# Tunables (environment): TRAY the binary, BUILDDIR of the mock player,
+# SETTLE seconds to wait after the start, IDLE seconds to measure over,
+# MAX_WAKEUPS allowed.
+
+TRAY=${TRAY:-../src/spotify-tray}
+BUILDDIR=${BUILDDIR:-.}
+SETTLE=${SETTLE:-3}
+IDLE=${IDLE:-60}
+MAX_WAKEUPS=${MAX_WAKEUPS:-2}
+
+# Run on a private bus, away from the real player and tray
+if [ -z "$IDLE_PRIVATE_BUS" ]; then
+	export IDLE_PRIVATE_BUS=1
+	exec dbus-run-session -- sh "$0" "$@"
+fi
+
+# Sums the voluntary and involuntary context switches of all the threads
+ctxt_switches() {
+	cat /proc/$1/task/*/status 2>/dev/null | awk '
+		/^(non)?voluntary_ctxt_switches:/ { n += $2 }
+		END { print n + 0 }'
+}
+
+tray_stat() {
+	gdbus call --session --dest name.smetana.SpotifyTray \
+		--object-path /name/smetana/SpotifyTray \
+		--method org.freedesktop.DBus.Properties.Get \
+		name.smetana.SpotifyTray "$1" 2>/dev/null |
+		sed -n 's/.*uint64 \([0-9]*\).*/\1/p'
+}
+
+"$BUILDDIR/mock-player" --rate 0 --window &
+mock_pid=$!
+sleep 1
+"$TRAY" --client-path=false --client-timeout=5 &
+tray_pid=$!
+sleep "$SETTLE"
+if ! kill -0 $tray_pid 2>/dev/null; then
+	echo "spotify-tray did not start" >&2
+	kill $mock_pid
+	exit 1
+fi
+timers=$(tray_stat TimerFires)
+wakeups=$(tray_stat LoopWakeups)
+ctxt=$(ctxt_switches $tray_pid)
+sleep "$IDLE"
+ctxt=$(($(ctxt_switches $tray_pid) - ctxt))
+# Every reading wakes the tray: only the last one counts in
+wakeups=$(($(tray_stat LoopWakeups) - ${wakeups:-0} - 1))
+timers=$(($(tray_stat TimerFires) - ${timers:-0}))
+kill $tray_pid $mock_pid
+wait 2>/dev/null
+
+echo "idle ${IDLE} s: loop_wakeups=$wakeups timer_fires=$timers" \
+	"ctxt_switches=$ctxt"
+if [ "$wakeups" -gt "$MAX_WAKEUPS" ]; then
+	echo "FAIL: more than $MAX_WAKEUPS main loop wakeups" >&2
+	exit 1
+fi
+echo "PASS"
@@ -0,0 +1,326 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gtk/gtk.h>
+
+/* Stand-in for the Spotify client MPRIS interface: once the Play method is
+ * called it emits PropertiesChanged signals at the given rate. The track ID
+ * of every new track carries the monotonic time of the emission so the
+ * receiver can compute the signal latency. With --window it also shows a
+ * window of the Spotify WM_CLASS for the tray to attach to. */
+
+#define MOCK_SERVICE_NAME "org.mpris.MediaPlayer2.spotify"
+#define MOCK_OBJECT_PATH "/org/mpris/MediaPlayer2"
+#define MOCK_PLAYER_INTERFACE "org.mpris.MediaPlayer2.Player"
+#define MOCK_TRACK_ID_PREFIX "spotify:track:bench:"
+
+static const gchar introspection_xml[] =
+	"<node>"
+	"  <interface name='" MOCK_PLAYER_INTERFACE "'>"
+	"    <method name='Play'/>"
+	"    <method name='Pause'/>"
+	"    <method name='PlayPause'/>"
+	"    <method name='Stop'/>"
+	"    <method name='Next'/>"
+	"    <method name='Previous'/>"
+	"    <method name='Seek'>"
+	"      <arg direction='in' name='Offset' type='x'/>"
+	"    </method>"
+	"    <signal name='Seeked'>"
+	"      <arg name='Position' type='x'/>"
+	"    </signal>"
+	"    <property name='PlaybackStatus' type='s' access='read'/>"
+	"    <property name='LoopStatus' type='s' access='readwrite'/>"
+	"    <property name='Shuffle' type='b' access='readwrite'/>"
+	"    <property name='Volume' type='d' access='readwrite'/>"
+	"    <property name='Rate' type='d' access='read'/>"
+	"    <property name='Position' type='x' access='read'/>"
+	"    <property name='Metadata' type='a{sv}' access='read'/>"
+	"  </interface>"
+	"</node>";
+
+struct _mock_s {
+	GDBusConnection *connection;
+	GMainLoop *loop;
+	gint rate; /* signals per second */
+	gint artists; /* artists per track */
+	gint title_length;
+	gint track_every; /* every n-th signal carries a new track */
+	gint count; /* signals to emit, 0 for no limit */
+	gint emitted;
+	gboolean playing;
+	gdouble volume;
+	gboolean shuffle;
+	gchar *loop_status;
+	guint64 track_num;
+	guint timer_id;
+	gchar *art_url;
+};
+
+typedef struct _mock_s mock_t;
+
+static GVariant *new_metadata(mock_t *mock)
+{
+	GVariantBuilder builder;
+	GVariantBuilder artists;
+	gchar *track_id, *title;
+	gint i;
+
+	track_id = g_strdup_printf(MOCK_TRACK_ID_PREFIX "%" G_GINT64_FORMAT,
+			g_get_monotonic_time());
+	title = g_strnfill(mock->title_length, 'x');
+	g_variant_builder_init(&artists, G_VARIANT_TYPE_STRING_ARRAY);
+	for (i = 0; i < mock->artists; i++)
+		g_variant_builder_add(&artists, "s", "Art\xc3\xadst \xe2\x99\xab");
+	g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&builder, "{sv}", "mpris:trackid",
+			g_variant_new_string(track_id));
+	g_variant_builder_add(&builder, "{sv}", "mpris:length",
+			g_variant_new_uint64(215000000));
+	g_variant_builder_add(&builder, "{sv}", "mpris:artUrl",
+			g_variant_new_string(mock->art_url ? mock->art_url :
+				"https://i.scdn.co/image/bench"));
+	g_variant_builder_add(&builder, "{sv}", "xesam:album",
+			g_variant_new_string("Benchmark Album"));
+	g_variant_builder_add(&builder, "{sv}", "xesam:albumArtist",
+			g_variant_builder_end(&artists));
+	g_variant_builder_init(&artists, G_VARIANT_TYPE_STRING_ARRAY);
+	for (i = 0; i < mock->artists; i++)
+		g_variant_builder_add(&artists, "s", "Art\xc3\xadst \xe2\x99\xab");
+	g_variant_builder_add(&builder, "{sv}", "xesam:artist",
+			g_variant_builder_end(&artists));
+	g_variant_builder_add(&builder, "{sv}", "xesam:autoRating",
+			g_variant_new_double(0.5));
+	g_variant_builder_add(&builder, "{sv}", "xesam:discNumber",
+			g_variant_new_int32(1));
+	g_variant_builder_add(&builder, "{sv}", "xesam:title",
+			g_variant_new_string(title));
+	g_variant_builder_add(&builder, "{sv}", "xesam:trackNumber",
+			g_variant_new_int32((gint32) (++mock->track_num % 20)));
+	g_variant_builder_add(&builder, "{sv}", "xesam:url",
+			g_variant_new_string("https://open.spotify.com/track/bench"));
+	g_free(track_id);
+	g_free(title);
+
+	return g_variant_builder_end(&builder);
+}
+
+static void emit_properties_changed(mock_t *mock)
+{
+	GVariantBuilder changed;
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	if (mock->emitted % mock->track_every == 0) {
+		g_variant_builder_add(&changed, "{sv}", "Metadata",
+				new_metadata(mock));
+	}
+	g_variant_builder_add(&changed, "{sv}", "PlaybackStatus",
+			g_variant_new_string(mock->playing ? "Playing" : "Paused"));
+	g_dbus_connection_emit_signal(mock->connection,
+			NULL, /* destination */
+			MOCK_OBJECT_PATH,
+			"org.freedesktop.DBus.Properties",
+			"PropertiesChanged",
+			g_variant_new("(sa{sv}as)", MOCK_PLAYER_INTERFACE, &changed, NULL),
+			NULL);
+	mock->emitted++;
+}
+
+/* The timer runs at most 1000 times a second, higher rates are reached by
+ * emitting several signals per tick. */
+static gboolean on_emit_timer(gpointer user_data)
+{
+	mock_t *mock = user_data;
+	gint per_tick = MAX(mock->rate / 1000, 1);
+	gint i;
+
+	for (i = 0; i < per_tick; i++) {
+		if (mock->count && (mock->emitted >= mock->count)) {
+			mock->timer_id = 0;
+			return G_SOURCE_REMOVE;
+		}
+		emit_properties_changed(mock);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void start_emitting(mock_t *mock)
+{
+	if (mock->timer_id || (mock->rate <= 0))
+		return;
+	mock->timer_id = g_timeout_add(MAX(1000 / mock->rate, 1),
+			on_emit_timer, mock);
+}
+
+static void handle_method_call(GDBusConnection *connection, const gchar *sender,
+		const gchar *object_path, const gchar *interface_name,
+		const gchar *method_name, GVariant *parameters,
+		GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	mock_t *mock = user_data;
+
+	if (g_strcmp0(method_name, "Play") == 0) {
+		mock->playing = TRUE;
+		start_emitting(mock);
+	} else if (g_strcmp0(method_name, "Pause") == 0) {
+		mock->playing = FALSE;
+	} else if (g_strcmp0(method_name, "PlayPause") == 0) {
+		mock->playing = !mock->playing;
+	} else if (g_strcmp0(method_name, "Seek") == 0) {
+		g_dbus_connection_emit_signal(connection, NULL, MOCK_OBJECT_PATH,
+				MOCK_PLAYER_INTERFACE, "Seeked",
+				g_variant_new("(x)", (gint64) 0), NULL);
+	}
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GVariant *handle_get_property(GDBusConnection *connection,
+		const gchar *sender, const gchar *object_path,
+		const gchar *interface_name, const gchar *property_name,
+		GError **error, gpointer user_data)
+{
+	mock_t *mock = user_data;
+
+	if (g_strcmp0(property_name, "PlaybackStatus") == 0)
+		return g_variant_new_string(mock->playing ? "Playing" : "Paused");
+	if (g_strcmp0(property_name, "LoopStatus") == 0)
+		return g_variant_new_string(mock->loop_status);
+	if (g_strcmp0(property_name, "Shuffle") == 0)
+		return g_variant_new_boolean(mock->shuffle);
+	if (g_strcmp0(property_name, "Volume") == 0)
+		return g_variant_new_double(mock->volume);
+	if (g_strcmp0(property_name, "Rate") == 0)
+		return g_variant_new_double(1.0);
+	if (g_strcmp0(property_name, "Position") == 0)
+		return g_variant_new_int64(0);
+	if (g_strcmp0(property_name, "Metadata") == 0)
+		return new_metadata(mock);
+	g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+			"No property %s", property_name);
+	return NULL;
+}
+
+static gboolean handle_set_property(GDBusConnection *connection,
+		const gchar *sender, const gchar *object_path,
+		const gchar *interface_name, const gchar *property_name,
+		GVariant *value, GError **error, gpointer user_data)
+{
+	mock_t *mock = user_data;
+
+	if (g_strcmp0(property_name, "Volume") == 0) {
+		mock->volume = g_variant_get_double(value);
+	} else if (g_strcmp0(property_name, "Shuffle") == 0) {
+		mock->shuffle = g_variant_get_boolean(value);
+	} else if (g_strcmp0(property_name, "LoopStatus") == 0) {
+		g_free(mock->loop_status);
+		mock->loop_status = g_variant_dup_string(value, NULL);
+	}
+
+	return TRUE;
+}
+
+static void on_bus_acquired(GDBusConnection *connection,
+		const gchar *name, gpointer user_data)
+{
+	mock_t *mock = user_data;
+	GDBusNodeInfo *introspection_data;
+	static const GDBusInterfaceVTable interface_vtable =
+	{
+		handle_method_call,
+		handle_get_property,
+		handle_set_property
+	};
+
+	mock->connection = connection;
+	introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+	if (g_dbus_connection_register_object(connection,
+				MOCK_OBJECT_PATH,
+				introspection_data->interfaces[0],
+				&interface_vtable,
+				mock, /* user_data */
+				NULL, /* user data free func */
+				NULL) == 0) /* GError** */
+		g_critical("Error registering the player interface");
+	g_dbus_node_info_unref(introspection_data);
+}
+
+static void on_name_lost(GDBusConnection *connection,
+		const gchar *name, gpointer user_data)
+{
+	mock_t *mock = user_data;
+
+	g_critical("Could not own the name %s", name);
+	g_main_loop_quit(mock->loop);
+}
+
+int main(int argc, char **argv)
+{
+	mock_t mock = { NULL, NULL, 100, 1, 32, 1, 0, 0,
+		FALSE, 0.5, FALSE, NULL, 0, 0 };
+	gchar *name_opt = NULL;
+	gboolean window_opt = FALSE;
+	GtkWidget *window;
+	GOptionEntry entries[] = {
+		{"rate", 'r', 0, G_OPTION_ARG_INT, &mock.rate,
+			"PropertiesChanged signals per second, default 100", "<n>"},
+		{"artists", 'a', 0, G_OPTION_ARG_INT, &mock.artists,
+			"Number of artists and album artists per track, default 1", "<n>"},
+		{"title-length", 'l', 0, G_OPTION_ARG_INT, &mock.title_length,
+			"Length of the track title, default 32", "<n>"},
+		{"track-every", 'e', 0, G_OPTION_ARG_INT, &mock.track_every,
+			"Every n-th signal carries a new track, the others just "
+			"the playback status, default 1", "<n>"},
+		{"count", 'c', 0, G_OPTION_ARG_INT, &mock.count,
+			"Number of signals to emit, default unlimited", "<n>"},
+		{"name", 'n', 0, G_OPTION_ARG_STRING, &name_opt,
+			"Bus name to own, default \"" MOCK_SERVICE_NAME "\"", "<name>"},
+		{"art-url", 'u', 0, G_OPTION_ARG_STRING, &mock.art_url,
+			"Album art URL to advertise, e.g. a file:// URL or a local "
+			"HTTP server", "<url>"},
+		{"window", 'w', 0, G_OPTION_ARG_NONE, &window_opt,
+			"Show a window passing for the Spotify client one", NULL},
+		{NULL}
+	};
+	GOptionContext *context;
+	GError *err = NULL;
+	guint owner_id;
+
+	context = g_option_context_new("- mock MPRIS player");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 2;
+	}
+	g_option_context_free(context);
+	mock.track_every = MAX(mock.track_every, 1);
+	mock.loop_status = g_strdup("None");
+	if (window_opt) {
+		if (!gtk_init_check(&argc, &argv)) {
+			g_printerr("Cannot open the display\n");
+			return 2;
+		}
+		window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+		gtk_window_set_title(GTK_WINDOW(window), "Mock player");
+		gtk_window_set_wmclass(GTK_WINDOW(window), "spotify", "Spotify");
+		gtk_widget_show(window);
+	}
+
+	mock.loop = g_main_loop_new(NULL, FALSE);
+	owner_id = g_bus_own_name(G_BUS_TYPE_SESSION,
+			name_opt ? name_opt : MOCK_SERVICE_NAME,
+			G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE,
+			on_bus_acquired,
+			NULL, /* on_name_acquired */
+			on_name_lost,
+			&mock, /* user_data */
+			NULL); /* user data free func */
+	g_main_loop_run(mock.loop);
+	g_bus_unown_name(owner_id);
+	g_main_loop_unref(mock.loop);
+	g_free(mock.loop_status);
+	g_free(name_opt);
+
+	return 1;
+}
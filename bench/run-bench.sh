@@ -0,0 +1,28 @@
+#!/bin/sh
+# Runs the proxy benchmark against the mock player on a private session bus.
+# Tunables (environment): RATE signals per second, SIGNALS track changes,
+# TRACK_EVERY (every n-th signal is a track change), ARTISTS per track,
+# TITLE_LENGTH, CALLS method call round trips.
+
+RATE=${RATE:-500}
+SIGNALS=${SIGNALS:-2000}
+TRACK_EVERY=${TRACK_EVERY:-1}
+ARTISTS=${ARTISTS:-4}
+TITLE_LENGTH=${TITLE_LENGTH:-64}
+CALLS=${CALLS:-500}
+BUILDDIR=${BUILDDIR:-.}
+
+export RATE SIGNALS TRACK_EVERY ARTISTS TITLE_LENGTH CALLS BUILDDIR
+
+echo "rate=$RATE signals=$SIGNALS track_every=$TRACK_EVERY" \
+	"artists=$ARTISTS title_length=$TITLE_LENGTH calls=$CALLS"
+exec dbus-run-session -- sh -c '
+	"$BUILDDIR/mock-player" --rate "$RATE" --artists "$ARTISTS" \
+		--title-length "$TITLE_LENGTH" --track-every "$TRACK_EVERY" \
+		--count $((SIGNALS * TRACK_EVERY)) &
+	mock_pid=$!
+	"$BUILDDIR/bench-proxy" --signals "$SIGNALS" --calls "$CALLS"
+	status=$?
+	kill $mock_pid 2>/dev/null
+	exit $status
+'
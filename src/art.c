@@ -0,0 +1,509 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include "art.h"
+
+/* Album art thumbnails. The images are fetched, decoded and scaled down in
+ * a worker thread; the results are kept in a small in-memory LRU and in
+ * a URL-keyed disk cache so a track played again costs neither a download
+ * nor a decode. The disk cache is capped, the least recently used files go
+ * first; failures are only remembered in memory, for a while. The main
+ * thread only ever looks up the finished thumbnails. */
+
+#define ART_CACHE_MAX 32 /* thumbnails kept in memory */
+#define ART_DISK_CACHE_MAX 256 /* thumbnail files */
+#define ART_RETRY_INTERVAL 120 /* sec before a failed URL is fetched again */
+#define ART_FETCH_MAX (8 * 1024 * 1024) /* bytes */
+#define ART_FETCH_TIMEOUT 10 /* sec */
+#define ART_REDIRECT_MAX 3
+#define ART_USER_AGENT "spotify-tray"
+
+struct _art_entry_s {
+	gchar *url;
+	GdkPixbuf *pixbuf; /* NULL if the image could not be loaded */
+	gint64 failed_at; /* monotonic, for a NULL pixbuf */
+};
+
+typedef struct _art_entry_s art_entry_t;
+
+struct _art_cache_s {
+	gint size; /* thumbnail size (px) */
+	gchar *cache_dir;
+	GHashTable *entries; /* url -> link in lru */
+	GQueue *lru; /* art_entry_t, the most recently used first */
+	GHashTable *pending; /* urls being fetched */
+	GCancellable *cancellable;
+};
+
+/* Everything the worker needs, it must not touch the cache itself */
+struct _art_job_s {
+	gchar *url;
+	gint size;
+	gchar *cache_dir;
+	gchar *cache_file;
+};
+
+typedef struct _art_job_s art_job_t;
+
+struct _art_file_s {
+	gchar *path;
+	gint64 mtime;
+};
+
+typedef struct _art_file_s art_file_t;
+
+static void art_entry_free(gpointer data)
+{
+	art_entry_t *entry = data;
+
+	g_free(entry->url);
+	if (entry->pixbuf)
+		g_object_unref(entry->pixbuf);
+	g_free(entry);
+}
+
+static void art_job_free(gpointer data)
+{
+	art_job_t *job = data;
+
+	g_free(job->url);
+	g_free(job->cache_dir);
+	g_free(job->cache_file);
+	g_free(job);
+}
+
+/* The disk cache is keyed by the URL, not by the image bytes: the key has
+ * to be known before the download for a hit to save it. The file name is
+ * the hash of the thumbnail size and the URL. */
+static gchar *url_cache_file(art_cache_t *cache, const gchar *url)
+{
+	gchar *key = g_strdup_printf("%d:%s", cache->size, url);
+	gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+	gchar *file_name = g_strconcat(hash, ".png", NULL);
+	gchar *path = g_build_filename(cache->cache_dir, file_name, NULL);
+
+	g_free(file_name);
+	g_free(hash);
+	g_free(key);
+
+	return path;
+}
+
+static GBytes *fetch_file(const gchar *url, GCancellable *cancellable,
+		GError **error)
+{
+	GFile *file = g_file_new_for_uri(url);
+	GBytes *bytes = g_file_load_bytes(file, cancellable, NULL, error);
+
+	g_object_unref(file);
+
+	return bytes;
+}
+
+/* Minimal HTTP/1.0 GET, enough for the image servers and for a local
+ * stand-in; the connection is closed by the server after the body. */
+static GBytes *fetch_http(const gchar *url, guint redirects,
+		GCancellable *cancellable, GError **error)
+{
+	gboolean https = g_str_has_prefix(url, "https://");
+	guint16 default_port = https ? 443 : 80;
+	const gchar *path = strchr(url + strlen(https ? "https://" : "http://"),
+			'/');
+	const gchar *hostname;
+	guint16 port;
+	GSocketConnectable *address;
+	GSocketClient *client;
+	GSocketConnection *connection = NULL;
+	GDataInputStream *in = NULL;
+	GByteArray *body = NULL;
+	gchar *resource, *host, *request = NULL, *line = NULL, *location = NULL;
+	guint status = 0;
+	guchar buf[16384];
+	gssize n;
+	GBytes *bytes = NULL;
+
+	address = g_network_address_parse_uri(url, default_port, error);
+	if (!address)
+		return NULL;
+	/* The fragment is for the client only, the port is part of the Host
+	 * unless it's the default one */
+	resource = path ? g_strndup(path, strcspn(path, "#")) : g_strdup("/");
+	hostname = g_network_address_get_hostname(G_NETWORK_ADDRESS(address));
+	port = g_network_address_get_port(G_NETWORK_ADDRESS(address));
+	if (strchr(hostname, ':'))
+		host = port == default_port ? g_strdup_printf("[%s]", hostname) :
+				g_strdup_printf("[%s]:%u", hostname, port);
+	else
+		host = port == default_port ? g_strdup(hostname) :
+				g_strdup_printf("%s:%u", hostname, port);
+	client = g_socket_client_new();
+	g_socket_client_set_timeout(client, ART_FETCH_TIMEOUT);
+	g_socket_client_set_tls(client, https);
+	connection = g_socket_client_connect(client, address, cancellable, error);
+	if (!connection)
+		goto out;
+
+	request = g_strdup_printf("GET %s HTTP/1.0\r\n"
+			"Host: %s\r\n"
+			"User-Agent: " ART_USER_AGENT "\r\n"
+			"Connection: close\r\n\r\n",
+			resource, host);
+	if (!g_output_stream_write_all(
+				g_io_stream_get_output_stream(G_IO_STREAM(connection)),
+				request, strlen(request), NULL, cancellable, error))
+		goto out;
+
+	in = g_data_input_stream_new(
+			g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+	g_data_input_stream_set_newline_type(in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+	line = g_data_input_stream_read_line(in, NULL, cancellable, error);
+	if (!line)
+		goto out;
+	if (sscanf(line, "HTTP/%*u.%*u %u", &status) != 1) {
+		g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				"Malformed HTTP status line");
+		goto out;
+	}
+	/* Headers: only the redirect target is of interest */
+	do {
+		g_free(line);
+		line = g_data_input_stream_read_line(in, NULL, cancellable, error);
+		if (!line)
+			goto out;
+		if (g_ascii_strncasecmp(line, "Location:", 9) == 0) {
+			g_free(location);
+			location = g_strstrip(g_strdup(line + 9));
+		}
+	} while (*line);
+
+	if ((status == 301 || status == 302 || status == 303 || status == 307 ||
+			status == 308) && location) {
+		if (redirects == 0) {
+			g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+					"Too many redirects");
+		} else if (!g_str_has_prefix(location, "http://") &&
+				!g_str_has_prefix(location, "https://")) {
+			g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+					"Unsupported redirect to %s", location);
+		} else {
+			bytes = fetch_http(location, redirects - 1, cancellable, error);
+		}
+		goto out;
+	}
+	if (status != 200) {
+		g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				"HTTP status %u", status);
+		goto out;
+	}
+
+	body = g_byte_array_new();
+	while ((n = g_input_stream_read(G_INPUT_STREAM(in), buf, sizeof(buf),
+					cancellable, error)) > 0) {
+		if (body->len + n > ART_FETCH_MAX) {
+			g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+					"The image is too large");
+			goto out;
+		}
+		g_byte_array_append(body, buf, (guint) n);
+	}
+	if (n == 0) {
+		bytes = g_byte_array_free_to_bytes(body);
+		body = NULL;
+	}
+out:
+	if (body)
+		g_byte_array_unref(body);
+	g_free(location);
+	g_free(line);
+	g_free(request);
+	g_free(host);
+	g_free(resource);
+	if (in)
+		g_object_unref(in);
+	if (connection)
+		g_object_unref(connection);
+	g_object_unref(client);
+	g_object_unref(address);
+
+	return bytes;
+}
+
+/* Scale the image down while decoding it, keeping the aspect ratio */
+static void on_size_prepared(GdkPixbufLoader *loader, gint width,
+		gint height, gpointer user_data)
+{
+	gint size = GPOINTER_TO_INT(user_data);
+
+	if (width <= size && height <= size)
+		return;
+	if (width > height)
+		gdk_pixbuf_loader_set_size(loader, size,
+				MAX(height * size / width, 1));
+	else
+		gdk_pixbuf_loader_set_size(loader,
+				MAX(width * size / height, 1), size);
+}
+
+static GdkPixbuf *decode_scaled(GBytes *bytes, gint size, GError **error)
+{
+	GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+	GdkPixbuf *pixbuf = NULL;
+
+	g_signal_connect(loader, "size-prepared",
+			G_CALLBACK(on_size_prepared), GINT_TO_POINTER(size));
+	if (gdk_pixbuf_loader_write_bytes(loader, bytes, error) &&
+			gdk_pixbuf_loader_close(loader, error)) {
+		pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+		if (pixbuf)
+			g_object_ref(pixbuf);
+	} else {
+		gdk_pixbuf_loader_close(loader, NULL);
+	}
+	g_object_unref(loader);
+
+	return pixbuf;
+}
+
+/* Store the thumbnail atomically so a concurrent reader never sees a half
+ * written file; failures only cost a later refetch. */
+static void save_thumbnail(GdkPixbuf *pixbuf, const gchar *cache_file)
+{
+	gchar *buffer;
+	gsize size;
+	GError *error = NULL;
+
+	if (!gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, "png", &error,
+				NULL)) {
+		g_debug("Could not encode the album art: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+	if (!g_file_set_contents(cache_file, buffer, (gssize) size, &error)) {
+		g_debug("Could not store the album art: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(buffer);
+}
+
+static gint compare_mtime(gconstpointer a, gconstpointer b)
+{
+	gint64 x = ((const art_file_t *) a)->mtime;
+	gint64 y = ((const art_file_t *) b)->mtime;
+
+	return (x > y) - (x < y);
+}
+
+/* Keep at most ART_DISK_CACHE_MAX thumbnails, removing the ones used the
+ * longest time ago; a hit refreshes the file time. Concurrent workers may
+ * race here, that only costs a failed unlink. */
+static void prune_disk_cache(const gchar *cache_dir)
+{
+	GDir *dir = g_dir_open(cache_dir, 0, NULL);
+	GArray *files;
+	art_file_t file;
+	GStatBuf st;
+	const gchar *name;
+	guint i;
+
+	if (!dir)
+		return;
+	files = g_array_new(FALSE, FALSE, sizeof(art_file_t));
+	while ((name = g_dir_read_name(dir))) {
+		/* Skip the temporary files of g_file_set_contents() */
+		if (!g_str_has_suffix(name, ".png"))
+			continue;
+		file.path = g_build_filename(cache_dir, name, NULL);
+		if (g_stat(file.path, &st) != 0) {
+			g_free(file.path);
+			continue;
+		}
+		file.mtime = (gint64) st.st_mtime;
+		g_array_append_val(files, file);
+	}
+	g_dir_close(dir);
+	if (files->len > ART_DISK_CACHE_MAX) {
+		g_array_sort(files, compare_mtime);
+		for (i = 0; i < files->len - ART_DISK_CACHE_MAX; i++)
+			g_unlink(g_array_index(files, art_file_t, i).path);
+	}
+	for (i = 0; i < files->len; i++)
+		g_free(g_array_index(files, art_file_t, i).path);
+	g_array_free(files, TRUE);
+}
+
+/* Worker thread */
+static void art_job_run(GTask *task, gpointer source_object,
+		gpointer task_data, GCancellable *cancellable)
+{
+	art_job_t *job = task_data;
+	GBytes *bytes = NULL;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+
+	/* Disk cache hit: the file holds the scaled thumbnail already */
+	pixbuf = gdk_pixbuf_new_from_file(job->cache_file, NULL);
+	if (pixbuf) {
+		g_utime(job->cache_file, NULL);
+		g_task_return_pointer(task, pixbuf, g_object_unref);
+		return;
+	}
+	if (g_str_has_prefix(job->url, "file://"))
+		bytes = fetch_file(job->url, cancellable, &error);
+	else if (g_str_has_prefix(job->url, "http://") ||
+			g_str_has_prefix(job->url, "https://"))
+		bytes = fetch_http(job->url, ART_REDIRECT_MAX, cancellable, &error);
+	else
+		g_set_error(&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				"Unsupported URL");
+	if (bytes) {
+		pixbuf = decode_scaled(bytes, job->size, &error);
+		g_bytes_unref(bytes);
+	}
+	if (!pixbuf) {
+		if (!error)
+			g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+					"Could not decode the image");
+		g_task_return_error(task, error);
+		return;
+	}
+	save_thumbnail(pixbuf, job->cache_file);
+	prune_disk_cache(job->cache_dir);
+	g_task_return_pointer(task, pixbuf, g_object_unref);
+}
+
+static void cache_insert(art_cache_t *cache, const gchar *url,
+		GdkPixbuf *pixbuf)
+{
+	art_entry_t *entry = g_malloc0(sizeof(art_entry_t));
+
+	entry->url = g_strdup(url);
+	entry->pixbuf = pixbuf;
+	entry->failed_at = pixbuf ? 0 : g_get_monotonic_time();
+	g_queue_push_head(cache->lru, entry);
+	g_hash_table_insert(cache->entries, entry->url, cache->lru->head);
+	while (g_queue_get_length(cache->lru) > ART_CACHE_MAX) {
+		entry = g_queue_pop_tail(cache->lru);
+		g_hash_table_remove(cache->entries, entry->url);
+		art_entry_free(entry);
+	}
+}
+
+static void on_art_fetched(GObject *source_object, GAsyncResult *result,
+		gpointer user_data)
+{
+	art_cache_t *cache = user_data;
+	GTask *task = G_TASK(result);
+	art_job_t *job = g_task_get_task_data(task);
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+
+	pixbuf = g_task_propagate_pointer(task, &error);
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* The cache is gone */
+		g_error_free(error);
+		return;
+	}
+	if (error) {
+		g_debug("Could not load the album art from %s: %s", job->url,
+				error->message);
+		g_error_free(error);
+	}
+	g_hash_table_remove(cache->pending, job->url);
+	/* Failures are cached too so the URL is not retried on every hover,
+	 * but only for ART_RETRY_INTERVAL: the network may be back then */
+	cache_insert(cache, job->url, pixbuf);
+}
+
+/* Creates a cache of thumbnails fitting into a square of size pixels. */
+art_cache_t *art_cache_new(gint size)
+{
+	art_cache_t *cache = g_malloc0(sizeof(art_cache_t));
+
+	cache->size = size;
+	cache->cache_dir = g_build_filename(g_get_user_cache_dir(),
+			"spotify-tray", "art", NULL);
+	if (g_mkdir_with_parents(cache->cache_dir, 0700) != 0)
+		g_warning("Could not create the album art cache %s",
+				cache->cache_dir);
+	cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+	cache->lru = g_queue_new();
+	cache->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+	cache->cancellable = g_cancellable_new();
+
+	return cache;
+}
+
+void art_cache_free(art_cache_t *cache)
+{
+	if (!cache)
+		return;
+	g_cancellable_cancel(cache->cancellable);
+	g_object_unref(cache->cancellable);
+	g_hash_table_destroy(cache->pending);
+	g_hash_table_destroy(cache->entries);
+	g_queue_free_full(cache->lru, art_entry_free);
+	g_free(cache->cache_dir);
+	g_free(cache);
+}
+
+/* Forget a failure old enough to retry the URL */
+static void expire_failure(art_cache_t *cache, const gchar *url)
+{
+	GList *link = g_hash_table_lookup(cache->entries, url);
+	art_entry_t *entry;
+
+	if (!link)
+		return;
+	entry = link->data;
+	if (entry->pixbuf || g_get_monotonic_time() - entry->failed_at <
+			ART_RETRY_INTERVAL * G_USEC_PER_SEC)
+		return;
+	g_hash_table_remove(cache->entries, url);
+	g_queue_delete_link(cache->lru, link);
+	art_entry_free(entry);
+}
+
+/* Starts loading the image in the background unless it's known already. */
+void art_cache_fetch(art_cache_t *cache, const gchar *url)
+{
+	art_job_t *job;
+	GTask *task;
+
+	if (!url || !*url)
+		return;
+	expire_failure(cache, url);
+	if (g_hash_table_contains(cache->entries, url) ||
+			g_hash_table_contains(cache->pending, url))
+		return;
+	g_hash_table_add(cache->pending, g_strdup(url));
+	job = g_malloc0(sizeof(art_job_t));
+	job->url = g_strdup(url);
+	job->size = cache->size;
+	job->cache_dir = g_strdup(cache->cache_dir);
+	job->cache_file = url_cache_file(cache, url);
+	task = g_task_new(NULL, cache->cancellable, on_art_fetched, cache);
+	g_task_set_task_data(task, job, art_job_free);
+	g_task_run_in_thread(task, art_job_run);
+	g_object_unref(task);
+}
+
+/* Returns the thumbnail (owned by the cache) or NULL if it's not loaded
+ * (yet); never blocks. */
+GdkPixbuf *art_cache_lookup(art_cache_t *cache, const gchar *url)
+{
+	GList *link;
+
+	if (!url || !(link = g_hash_table_lookup(cache->entries, url)))
+		return NULL;
+	g_queue_unlink(cache->lru, link);
+	g_queue_push_head_link(cache->lru, link);
+
+	return ((art_entry_t *) link->data)->pixbuf;
+}
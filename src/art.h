@@ -0,0 +1,11 @@
+#ifndef _ART_H
+#define _ART_H
+
+typedef struct _art_cache_s art_cache_t;
+
+art_cache_t *art_cache_new(gint size);
+void art_cache_free(art_cache_t *cache);
+void art_cache_fetch(art_cache_t *cache, const gchar *url);
+GdkPixbuf *art_cache_lookup(art_cache_t *cache, const gchar *url);
+
+#endif
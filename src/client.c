@@ -0,0 +1,218 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <sys/wait.h>
+
+#include "proxy.h"
+#include "players.h"
+#include "winctrl.h"
+#include "client.h"
+#include "timer.h"
+
+#define DBUS_SERVICE_NAME "org.freedesktop.DBus"
+#define DBUS_OBJECT_PATH "/org/freedesktop/DBus"
+#define DBUS_INTERFACE "org.freedesktop.DBus"
+
+struct _client_name_watch_s {
+	GDBusConnection *bus;
+	guint owner_changed_id;
+	client_name_func_t func;
+	gpointer user_data;
+};
+
+struct _client_search_s {
+	win_client_t found;
+	winctrl_watch_t *watch;
+	client_name_watch_t *name_watch;
+	guint timeout_id;
+	guint idle_id;
+	client_search_func_t func;
+	gpointer user_data;
+};
+
+/* Reaps the launched process if it was not the client itself. */
+static void on_child_exit(GPid pid, gint status, gpointer user_data)
+{
+	g_debug("Watched process %d exited", pid);
+	waitpid((pid_t) pid, NULL, 0);
+	g_spawn_close_pid(pid);
+}
+
+static void stop_search(client_search_t *search)
+{
+	winctrl_unwatch_client_list(search->watch);
+	client_unwatch_player_name(search->name_watch);
+	if (search->timeout_id)
+		g_source_remove(search->timeout_id);
+	if (search->idle_id)
+		g_source_remove(search->idle_id);
+	g_free(search);
+}
+
+static void finish_search(client_search_t *search)
+{
+	win_client_t found = search->found;
+	client_search_func_t func = search->func;
+	gpointer user_data = search->user_data;
+
+	/* Stop watching first: the callback may start a new search */
+	stop_search(search);
+	func(&found, user_data);
+}
+
+/* Rescan the window list, stop searching as soon as the client is there. */
+static void scan(gpointer user_data)
+{
+	client_search_t *search = user_data;
+
+	winctrl_get_client(&search->found);
+	if (search->found.window)
+		finish_search(search);
+}
+
+static gboolean on_first_scan(gpointer user_data)
+{
+	client_search_t *search = user_data;
+
+	search->idle_id = 0;
+	scan(search);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void on_name_owner_changed(GDBusConnection *connection,
+		const gchar *sender_name, const gchar *object_path,
+		const gchar *interface_name, const gchar *signal_name,
+		GVariant *parameters, gpointer user_data)
+{
+	client_name_watch_t *watch = user_data;
+	const gchar *name, *new_owner;
+
+	g_variant_get(parameters, "(&s&s&s)", &name, NULL, &new_owner);
+	if (!*new_owner)
+		return;
+	g_debug("D-Bus name %s appeared", name);
+	watch->func(watch->user_data);
+}
+
+/* Call func whenever the player (the name following
+ * "org.mpris.MediaPlayer2.", "*" for any) or one of its instances, like
+ * the proxy accepts them, registers on the bus. The names present already
+ * don't count. Returns NULL without the session bus. */
+client_name_watch_t *client_watch_player_name(const gchar *player_name,
+		client_name_func_t func, gpointer user_data)
+{
+	client_name_watch_t *watch;
+	GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	gchar *name_namespace;
+
+	if (!bus)
+		return NULL;
+	name_namespace = g_strcmp0(player_name, "*") == 0 ?
+		g_strdup(PLAYERS_NAMESPACE) :
+		g_strconcat(PLAYERS_NAMESPACE ".", player_name, NULL);
+	watch = g_malloc(sizeof(client_name_watch_t));
+	watch->bus = bus;
+	watch->func = func;
+	watch->user_data = user_data;
+	watch->owner_changed_id = g_dbus_connection_signal_subscribe(bus,
+			DBUS_SERVICE_NAME,
+			DBUS_INTERFACE,
+			"NameOwnerChanged",
+			DBUS_OBJECT_PATH,
+			name_namespace, /* arg0: the name */
+			G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
+			on_name_owner_changed,
+			watch,
+			NULL); /* user data free func */
+	g_free(name_namespace);
+
+	return watch;
+}
+
+void client_unwatch_player_name(client_name_watch_t *watch)
+{
+	if (!watch)
+		return;
+	g_dbus_connection_signal_unsubscribe(watch->bus,
+			watch->owner_changed_id);
+	g_object_unref(watch->bus);
+	g_free(watch);
+}
+
+/* The client has registered its MPRIS name: its window is usually mapped
+ * by now, so look for it. */
+static void on_client_name_appeared(gpointer user_data)
+{
+	scan(user_data);
+}
+
+static gboolean on_search_timeout(gpointer user_data)
+{
+	client_search_t *search = user_data;
+
+	search->timeout_id = 0;
+	finish_search(search);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Look for the Spotify client window every time the window manager changes
+ * the client list or the client registers on D-Bus, for at most timeout
+ * seconds. The first scan runs from the main loop, so the client may be
+ * launched right after starting the search without missing any change.
+ * The search frees itself after calling func. */
+client_search_t *client_search_new(const gchar *player_name, guint timeout,
+		client_search_func_t func, gpointer user_data)
+{
+	client_search_t *search = g_malloc0(sizeof(client_search_t));
+
+	search->func = func;
+	search->user_data = user_data;
+	search->watch = winctrl_watch_client_list(scan, search);
+	search->name_watch = client_watch_player_name(player_name,
+			on_client_name_appeared, search);
+	search->timeout_id = timer_add_seconds(timeout, on_search_timeout,
+			search);
+	search->idle_id = g_idle_add(on_first_scan, search);
+
+	return search;
+}
+
+/* Stop the search without calling its callback */
+void client_search_cancel(client_search_t *search)
+{
+	if (search)
+		stop_search(search);
+}
+
+/* Launch the Spotify client application, the process PID is stored at pid
+ * (0 on failure). */
+gboolean client_launch(gchar **client_app_argv, GPid *pid)
+{
+	GError *err = NULL;
+
+	*pid = 0;
+	if (!g_spawn_async(NULL, /* work dir (doesn't matter: inherit') */
+				client_app_argv, /* argv */
+				NULL, /* envp -- inherit */
+				G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, /* flags */
+				NULL, /* setup function -- not needed */
+				NULL, /* user data */
+				pid, /* store pid of the client app */
+				&err)) {
+		g_critical("Failed to start the client application: %s", err->message);
+		g_error_free(err);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Reap the launched process once it exits */
+void client_reap(GPid pid)
+{
+	g_child_watch_add(pid, on_child_exit, NULL);
+}
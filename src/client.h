@@ -0,0 +1,21 @@
+#ifndef _CLIENT_H
+#define _CLIENT_H
+
+/* Called when the search ends; found->window is NULL on timeout. */
+typedef void (*client_search_func_t)(win_client_t *found,
+		gpointer user_data);
+typedef struct _client_search_s client_search_t;
+/* Called when a bus name of the watched player gets an owner */
+typedef void (*client_name_func_t)(gpointer user_data);
+typedef struct _client_name_watch_s client_name_watch_t;
+
+client_name_watch_t *client_watch_player_name(const gchar *player_name,
+		client_name_func_t func, gpointer user_data);
+void client_unwatch_player_name(client_name_watch_t *watch);
+client_search_t *client_search_new(const gchar *player_name, guint timeout,
+		client_search_func_t func, gpointer user_data);
+void client_search_cancel(client_search_t *search);
+gboolean client_launch(gchar **client_app_argv, GPid *pid);
+void client_reap(GPid pid);
+
+#endif
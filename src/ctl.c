@@ -0,0 +1,229 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gio/gio.h>
+#include "tray_dbus_iface.h"
+
+/* spotify-tray-ctl: controls the running tray from scripts and hotkeys.
+ * Only GIO is needed, no display connection or toolkit initialization, so
+ * a command costs a few D-Bus messages. Several commands on the command
+ * line are sent as a single batch. */
+
+#define CTL_CALL_TIMEOUT 1000 /* msec */
+
+struct _ctl_command_s {
+	const gchar *name;
+	const gchar *method;
+	const gchar *arg_type; /* NULL if there's no argument */
+	gboolean batch; /* can be a part of a batch */
+	const gchar *description;
+};
+
+typedef struct _ctl_command_s ctl_command_t;
+
+static const ctl_command_t ctl_commands[] = {
+	{ "raise", TRAY_RAISE_WIN_METHOD, NULL, TRUE,
+		"Show and raise the client window" },
+	{ "hide", TRAY_HIDE_WIN_METHOD, NULL, TRUE,
+		"Hide the client window" },
+	{ "toggle", TRAY_TOGGLE_WIN_METHOD, NULL, TRUE,
+		"Toggle the client window visibility" },
+	{ "play-pause", TRAY_PLAY_PAUSE_METHOD, NULL, TRUE,
+		"Toggle play / pause" },
+	{ "play", TRAY_PLAY_METHOD, NULL, TRUE,
+		"Start or resume the playback" },
+	{ "pause", TRAY_PAUSE_METHOD, NULL, TRUE,
+		"Pause the playback" },
+	{ "stop", TRAY_STOP_METHOD, NULL, TRUE,
+		"Stop the playback" },
+	{ "next", TRAY_NEXT_METHOD, NULL, TRUE,
+		"Skip to the next track" },
+	{ "previous", TRAY_PREVIOUS_METHOD, NULL, TRUE,
+		"Skip to the previous track" },
+	{ "seek", TRAY_SEEK_METHOD, "x", TRUE,
+		"SECONDS  Seek forward (or back if negative)" },
+	{ "volume", TRAY_SET_VOLUME_METHOD, "d", TRUE,
+		"LEVEL  Set the volume, 0.0 -- 1.0" },
+	{ "stats", TRAY_GET_STATS_METHOD, NULL, FALSE,
+		"Print the tray runtime statistics" },
+	{ NULL }
+};
+
+static const ctl_command_t *find_command(const gchar *name)
+{
+	const ctl_command_t *command;
+
+	for (command = ctl_commands; command->name; command++)
+		if (g_strcmp0(command->name, name) == 0)
+			return command;
+
+	return NULL;
+}
+
+static gchar *commands_description(void)
+{
+	GString *description = g_string_new("Commands:");
+	const ctl_command_t *command;
+
+	for (command = ctl_commands; command->name; command++)
+		g_string_append_printf(description, "\n  %-12s%s", command->name,
+				command->description);
+	g_string_append(description, "\n\nSeveral commands are executed "
+			"in one call, e.g. \"next seek 30\".");
+
+	return g_string_free(description, FALSE);
+}
+
+/* Returns the command argument, an empty string for commands without
+ * one */
+static GVariant *parse_arg(const ctl_command_t *command, const gchar *arg)
+{
+	gchar *end;
+	gdouble value;
+
+	if (!command->arg_type)
+		return g_variant_new_string("");
+	if (!arg)
+		return NULL;
+	value = g_ascii_strtod(arg, &end);
+	if (end == arg || *end)
+		return NULL;
+	if (command->arg_type[0] == 'x')
+		return g_variant_new_int64((gint64) (value * G_USEC_PER_SEC));
+
+	return g_variant_new_double(value);
+}
+
+/* Builds the call parameters from the command line; returns the method to
+ * call or NULL on error. */
+static const gchar *parse_commands(gint argc, gchar **argv,
+		GVariant **parameters)
+{
+	const ctl_command_t *command, *first = NULL;
+	GVariantBuilder batch;
+	GVariant *arg;
+	guint n = 0;
+	gint i;
+
+	g_variant_builder_init(&batch, G_VARIANT_TYPE("a(sv)"));
+	/* Tolerate an explicit end of the options */
+	if (argc > 1 && g_strcmp0(argv[1], "--") == 0) {
+		argc--;
+		argv++;
+	}
+	for (i = 1; i < argc; i++, n++) {
+		if (!(command = find_command(argv[i]))) {
+			g_printerr("Unknown command \"%s\"\n", argv[i]);
+			goto err;
+		}
+		arg = parse_arg(command, command->arg_type ? argv[i + 1] : NULL);
+		if (!arg) {
+			g_printerr("%s needs a number argument\n", command->name);
+			goto err;
+		}
+		if (command->arg_type)
+			i++;
+		if (!first)
+			first = command;
+		if ((n > 0 || i + 1 < argc) && !command->batch) {
+			g_variant_unref(g_variant_ref_sink(arg));
+			g_printerr("%s cannot be combined with other commands\n",
+					command->name);
+			goto err;
+		}
+		g_variant_builder_add(&batch, "(sv)", command->method, arg);
+	}
+	if (n == 0 || n > TRAY_BATCH_MAX) {
+		g_printerr("Expected 1 to %d commands\n", TRAY_BATCH_MAX);
+		goto err;
+	}
+	if (n > 1) {
+		*parameters = g_variant_new("(@a(sv))",
+				g_variant_builder_end(&batch));
+		return TRAY_EXECUTE_BATCH_METHOD;
+	}
+	g_variant_builder_clear(&batch);
+	if (first->arg_type) {
+		arg = parse_arg(first, argv[2]);
+		*parameters = g_variant_new_tuple(&arg, 1);
+	}
+
+	return first->method;
+err:
+	g_variant_builder_clear(&batch);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GDBusConnection *bus;
+	GVariant *parameters = NULL, *result;
+	const gchar *method;
+	gchar *text;
+	GError *err = NULL;
+
+	context = g_option_context_new("COMMAND [ARGUMENT] ... - control "
+			"the running spotify-tray");
+	text = commands_description();
+	g_option_context_set_description(context, text);
+	g_free(text);
+	/* The options end at the first command: "seek -10" is an argument */
+	g_option_context_set_strict_posix(context, TRUE);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		g_option_context_free(context);
+		return 2;
+	}
+	if (argc < 2 || !(method = parse_commands(argc, argv, &parameters))) {
+		text = g_option_context_get_help(context, TRUE, NULL);
+		g_printerr("%s", text);
+		g_free(text);
+		g_option_context_free(context);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+	if (!bus) {
+		g_printerr("Could not connect to the session bus: %s\n",
+				err->message);
+		g_error_free(err);
+		if (parameters)
+			g_variant_unref(g_variant_ref_sink(parameters));
+		return 1;
+	}
+	/* Never start anything by the call */
+	result = g_dbus_connection_call_sync(bus,
+			TRAY_SERVICE_NAME,
+			TRAY_OBJECT_PATH,
+			TRAY_INTERFACE,
+			method,
+			parameters,
+			NULL, /* reply type */
+			G_DBUS_CALL_FLAGS_NO_AUTO_START,
+			CTL_CALL_TIMEOUT,
+			NULL, /* GCancellable */
+			&err);
+	g_object_unref(bus);
+	if (!result) {
+		if (g_error_matches(err, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) ||
+				g_error_matches(err, G_DBUS_ERROR,
+					G_DBUS_ERROR_NAME_HAS_NO_OWNER))
+			g_printerr("spotify-tray is not running\n");
+		else
+			g_printerr("%s failed: %s\n", method, err->message);
+		g_error_free(err);
+		return 1;
+	}
+	if (g_variant_n_children(result) > 0) {
+		text = g_variant_print(result, TRUE);
+		g_print("%s\n", text);
+		g_free(text);
+	}
+	g_variant_unref(result);
+
+	return 0;
+}
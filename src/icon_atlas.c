@@ -0,0 +1,179 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include "proxy.h"
+#include "icon_atlas.h"
+
+/* The tray icon variants for all the playback states. They are rendered
+ * only when the icon size or the icon theme changes; a playback status
+ * change just picks one of the ready pixbufs. GtkStatusIcon takes only
+ * pixbufs and reports its size in device pixels, so the scale factor is
+ * covered by rendering at the reported size. */
+
+#define ICON_ATLAS_STATES (PROXY_STATUS_STOPPED + 1)
+
+struct _icon_atlas_s {
+	gchar *icon_file; /* NULL to use the icon theme */
+	gint size; /* px, 0 until known */
+	GdkPixbuf *pixbuf[ICON_ATLAS_STATES];
+};
+
+/* Find a suitable icon */
+const gchar *icon_atlas_lookup_icon(void)
+{
+	GtkIconTheme *theme = gtk_icon_theme_get_default();
+	static const gchar *icon_name[] = {
+		"spotify-indicator",
+		"spotify",
+		"spotify-client",
+		NULL
+	};
+	guint i;
+
+	for (i = 0; icon_name[i] != NULL; i++)
+		if (gtk_icon_theme_has_icon(theme, icon_name[i])) {
+			g_debug("Found icon: %s", icon_name[i]);
+			return icon_name[i];
+		}
+	g_critical("Could not find any suitable icon file");
+
+	return NULL;
+}
+
+static GdkPixbuf *load_base_icon(icon_atlas_t *atlas)
+{
+	const gchar *icon_name;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+
+	if (atlas->icon_file) {
+		pixbuf = gdk_pixbuf_new_from_file_at_size(atlas->icon_file,
+				atlas->size, atlas->size, &error);
+	} else {
+		if (!(icon_name = icon_atlas_lookup_icon()))
+			return NULL;
+		pixbuf = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(),
+				icon_name, atlas->size, GTK_ICON_LOOKUP_FORCE_SIZE, &error);
+	}
+	if (!pixbuf) {
+		g_warning("Could not load the tray icon: %s", error->message);
+		g_error_free(error);
+	}
+
+	return pixbuf;
+}
+
+/* Draws the status emblem into the bottom right quarter of the icon */
+static void draw_emblem(cairo_t *cr, gint size,
+		proxy_playback_status_t status)
+{
+	gdouble r = size / 4.0;
+	gdouble cx = size - r, cy = size - r;
+	gdouble g = r * 0.45; /* glyph half size */
+
+	cairo_arc(cr, cx, cy, r, 0.0, 2 * G_PI);
+	cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.75);
+	cairo_fill(cr);
+	cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+	switch (status) {
+	case PROXY_STATUS_PLAYING:
+		cairo_move_to(cr, cx - g * 0.7, cy - g);
+		cairo_line_to(cr, cx + g, cy);
+		cairo_line_to(cr, cx - g * 0.7, cy + g);
+		cairo_close_path(cr);
+		break;
+	case PROXY_STATUS_PAUSED:
+		cairo_rectangle(cr, cx - g, cy - g, g * 0.7, 2 * g);
+		cairo_rectangle(cr, cx + g * 0.3, cy - g, g * 0.7, 2 * g);
+		break;
+	default:
+		cairo_rectangle(cr, cx - g * 0.8, cy - g * 0.8, g * 1.6, g * 1.6);
+		break;
+	}
+	cairo_fill(cr);
+}
+
+static GdkPixbuf *render_state(GdkPixbuf *base, gint size,
+		proxy_playback_status_t status)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	GdkPixbuf *pixbuf, *faded = NULL;
+
+	if (status == PROXY_STATUS_UNKNOWN)
+		return g_object_ref(base);
+	/* Stopped: greyed out */
+	if (status == PROXY_STATUS_STOPPED) {
+		faded = gdk_pixbuf_copy(base);
+		gdk_pixbuf_saturate_and_pixelate(base, faded, 0.0, FALSE);
+	}
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+	cr = cairo_create(surface);
+	gdk_cairo_set_source_pixbuf(cr, faded ? faded : base,
+			(size - gdk_pixbuf_get_width(base)) / 2,
+			(size - gdk_pixbuf_get_height(base)) / 2);
+	cairo_paint(cr);
+	draw_emblem(cr, size, status);
+	cairo_destroy(cr);
+	pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
+	cairo_surface_destroy(surface);
+	if (faded)
+		g_object_unref(faded);
+
+	return pixbuf;
+}
+
+static void clear_pixbufs(icon_atlas_t *atlas)
+{
+	gint i;
+
+	for (i = 0; i < ICON_ATLAS_STATES; i++)
+		g_clear_object(&atlas->pixbuf[i]);
+}
+
+icon_atlas_t *icon_atlas_new(const gchar *icon_file)
+{
+	icon_atlas_t *atlas = g_malloc0(sizeof(icon_atlas_t));
+
+	atlas->icon_file = g_strdup(icon_file);
+
+	return atlas;
+}
+
+void icon_atlas_free(icon_atlas_t *atlas)
+{
+	if (!atlas)
+		return;
+	clear_pixbufs(atlas);
+	g_free(atlas->icon_file);
+	g_free(atlas);
+}
+
+/* (Re)renders the variants for all the states at the given size; returns
+ * FALSE if the icon could not be loaded. */
+gboolean icon_atlas_render(icon_atlas_t *atlas, gint size)
+{
+	GdkPixbuf *base;
+	gint i;
+
+	atlas->size = size;
+	clear_pixbufs(atlas);
+	if (size <= 0 || !(base = load_base_icon(atlas)))
+		return FALSE;
+	for (i = 0; i < ICON_ATLAS_STATES; i++)
+		atlas->pixbuf[i] = render_state(base, size, i);
+	g_object_unref(base);
+
+	return TRUE;
+}
+
+/* Returns the pixbuf for the state (owned by the atlas) or NULL if the
+ * atlas has not been rendered. */
+GdkPixbuf *icon_atlas_get(icon_atlas_t *atlas,
+		proxy_playback_status_t status)
+{
+	return atlas->pixbuf[status < ICON_ATLAS_STATES ?
+		status : PROXY_STATUS_UNKNOWN];
+}
@@ -0,0 +1,13 @@
+#ifndef _ICON_ATLAS_H
+#define _ICON_ATLAS_H
+
+typedef struct _icon_atlas_s icon_atlas_t;
+
+icon_atlas_t *icon_atlas_new(const gchar *icon_file);
+void icon_atlas_free(icon_atlas_t *atlas);
+gboolean icon_atlas_render(icon_atlas_t *atlas, gint size);
+GdkPixbuf *icon_atlas_get(icon_atlas_t *atlas,
+		proxy_playback_status_t status);
+const gchar *icon_atlas_lookup_icon(void);
+
+#endif
@@ -4,70 +4,63 @@
 
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
-#include <sys/wait.h>
 
 #include "proxy.h"
-#include "tray_status_icon.h"
 #include "winctrl.h"
+#include "client.h"
+#include "supervisor.h"
+#include "tray_status_icon.h"
 #include "tray_dbus.h"
+#include "stats.h"
+#include "trace.h"
 
 #define DEFAULT_CLIENT_APP_PATH "spotify"
-#define CLIENT_FIND_ATTEMPTS 5
+#define DEFAULT_CLIENT_TIMEOUT 30 /* seconds */
+
+struct _client_wait_s {
+	win_client_t *client;
+	GMainLoop *loop;
+};
+
+typedef struct _client_wait_s client_wait_t;
 
-/* Gets called when the Spotify client exits. */
-static void on_child_exit(GPid pid, gint status, gpointer user_data)
+static void on_client_found(win_client_t *found, gpointer user_data)
 {
-	g_debug("Watched process %d exited", pid);
-	waitpid((pid_t) pid, NULL, 0);
-	g_spawn_close_pid(pid);
+	client_wait_t *wait = user_data;
+
+	*wait->client = *found;
+	g_main_loop_quit(wait->loop);
 }
 
 
 /* Try to get the GdkWindow for the Spotify client application, try to
  * spawn a new process using the client_app_argv if the window is not found
- * at the first attempt */
-void get_client_window(win_client_t *win_client, gchar **client_app_argv)
+ * at the first attempt and wait at most timeout seconds for it to appear.
+ * The PID of the spawned process (or 0) is stored at spawned_pid, the
+ * caller is responsible for reaping it. The player's MPRIS name appearing
+ * on the bus triggers a rescan. */
+void get_client_window(win_client_t *win_client, const gchar *player_name,
+		gchar **client_app_argv, guint timeout, GPid *spawned_pid)
 {
-	GPid client_pid;
-	GError *err = NULL;
-	gint i;
 	win_client_t found_client = { NULL, 0 };
+	client_wait_t wait = { &found_client, NULL };
+	client_search_t *search;
 
+	*spawned_pid = 0;
 	/* Try to get the window */
 	winctrl_get_client(&found_client);
-	if (!(found_client.window)) {
-		/* No window found: launch Spotify client app. */
-		if (!g_spawn_async(NULL, /* work dir (doesn't matter: inherit') */
-					client_app_argv, /* argv */
-					NULL, /* envp -- inherit */
-					G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, /* flags */
-					NULL, /* setup function -- not needed */
-					NULL, /* user data */
-					&client_pid, /* store pid of the client app */
-					&err)) {
-			g_critical("Failed to start the client application: %s", err->message);
-			goto error;
-		} else {
-			/* App launched, watch for its exit. */
-			g_child_watch_add(client_pid, on_child_exit, NULL);
-		}
-		/* App launched, it double forks; need to find the window and PID */
-		for (i = 0; i < CLIENT_FIND_ATTEMPTS; i++) {
-			/* Spotify takes time to start up, so wait a while. */
-			g_usleep(5E5); /* 0.5 sec */
-			winctrl_get_client(&found_client);
-			if (!(found_client.window)) {
-				/* Still nothing, try again. */
-				g_warning("Could not find the Spotify client window: "
-						"attempting to launch the application, attempt %d/%d",
-						i + 1, CLIENT_FIND_ATTEMPTS);
-			} else {
-				/* Got the window, stop trying. */
-				break;
-			}
-		}
-	}
-error:
+	if (found_client.window)
+		goto out;
+	/* No window found: launch Spotify client app and wait for the window
+	 * to show up. */
+	wait.loop = g_main_loop_new(NULL, FALSE);
+	search = client_search_new(player_name, timeout, on_client_found, &wait);
+	if (client_launch(client_app_argv, spawned_pid))
+		g_main_loop_run(wait.loop);
+	else
+		client_search_cancel(search);
+	g_main_loop_unref(wait.loop);
+out:
 	win_client->window = found_client.window;
 	win_client->pid = found_client.pid;
 }
@@ -78,25 +71,69 @@ int main(int argc, char **argv)
 	gchar **client_app_argv = NULL;
 	gchar *client_app_path_opt = NULL;
 	gchar *icon_path_opt = NULL;
+	gchar *scroll_opt = NULL;
+	gchar *tooltip_opt = NULL;
+	gchar *trace_file_opt = NULL;
+	gchar *player_opt = NULL;
+	tray_scroll_mode_t scroll_mode = TRAY_SCROLL_TRACK;
 	gchar **client_app_args_opt = NULL;
 	guint n_opts, i;
+	gint client_timeout_opt = DEFAULT_CLIENT_TIMEOUT;
 	gboolean toggle_window = FALSE;
 	gboolean hide_on_start = FALSE;
+	gboolean supervise = FALSE;
+	gboolean relaunch = FALSE;
+	gboolean headless = FALSE;
 	GOptionEntry entries[] = {
 		{"client-path", 'c', 0, G_OPTION_ARG_STRING, &client_app_path_opt,
 			"Path to the Spotify client application, default \""
 				DEFAULT_CLIENT_APP_PATH "\"",
 			"<path>"},
+		{"client-timeout", 'w', 0, G_OPTION_ARG_INT, &client_timeout_opt,
+			"Seconds to wait for the client window to appear, default "
+				G_STRINGIFY(DEFAULT_CLIENT_TIMEOUT),
+			"<seconds>"},
 		{"icon", 'i', 0, G_OPTION_ARG_STRING, &icon_path_opt,
 			"Use the given file for the status icon, default is autodetect "
 			"from the GTK+ theme",
 			"<path>"},
+		{"scroll", 's', 0, G_OPTION_ARG_STRING, &scroll_opt,
+			"What the mouse wheel does: \"track\" (default), \"seek\" "
+			"or \"volume\"; Shift seeks and Ctrl changes volume regardless",
+			"<mode>"},
+		{"tooltip", 'f', 0, G_OPTION_ARG_STRING, &tooltip_opt,
+			"Tooltip markup format: %t title, %a artists, %r album artists, "
+			"%A album, %n track number, %l length, %p position, "
+			"%m remaining time",
+			"<format>"},
 		{"toggle", 't', 0, G_OPTION_ARG_NONE, &toggle_window,
 			"Toggle window visibility if a running instance is detected",
 			NULL},
 		{"minimized", 'm', 0, G_OPTION_ARG_NONE, &hide_on_start,
 			"Hide the client application after it's detected",
 			NULL},
+		{"supervise", 'S', 0, G_OPTION_ARG_NONE, &supervise,
+			"Keep running when the client exits and attach to it again "
+			"once it's back",
+			NULL},
+		{"relaunch", 'R', 0, G_OPTION_ARG_NONE, &relaunch,
+			"Like --supervise but also launch the client again after it "
+			"exits, backing off when it keeps crashing",
+			NULL},
+		{"player", 'p', 0, G_OPTION_ARG_STRING, &player_opt,
+			"MPRIS player to control, the name following "
+			"\"org.mpris.MediaPlayer2.\" (its instances match too) or "
+			"\"*\" for the one playing last, default \""
+				PROXY_DEFAULT_PLAYER "\"",
+			"<name>"},
+		{"headless", 'H', 0, G_OPTION_ARG_NONE, &headless,
+			"No tray icon, only the D-Bus interface for the window and "
+			"playback control",
+			NULL},
+		{"startup-trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_file_opt,
+			"Write the timing of the startup phases to the file in the "
+			"Chrome trace-event format",
+			"<file>"},
 		{G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY,
 			&client_app_args_opt,
 			"The rest of the command line will be passed "
@@ -110,6 +147,10 @@ int main(int argc, char **argv)
 	win_client_t win_client = { NULL, 0 };
 	guint bus_id;
 	GdkDisplay *display;
+	GPid spawned_pid;
+	gboolean client_is_child;
+	supervisor_t *supervisor = NULL;
+	gint64 start_time = g_get_monotonic_time();
 
 	/* Parse command line options */
 	context = g_option_context_new("- system tray icon for "
@@ -120,6 +161,17 @@ int main(int argc, char **argv)
 	g_option_context_add_main_entries(context, entries, NULL);
 	g_option_context_parse(context, &argc, &argv, &err);
 	g_option_context_free(context);
+	if (client_timeout_opt <= 0)
+		client_timeout_opt = DEFAULT_CLIENT_TIMEOUT;
+	if (g_strcmp0(scroll_opt, "seek") == 0)
+		scroll_mode = TRAY_SCROLL_SEEK;
+	else if (g_strcmp0(scroll_opt, "volume") == 0)
+		scroll_mode = TRAY_SCROLL_VOLUME;
+	else if (scroll_opt && (g_strcmp0(scroll_opt, "track") != 0))
+		g_warning("Unknown scroll mode \"%s\", using \"track\"", scroll_opt);
+	g_free(scroll_opt);
+	if (trace_file_opt)
+		trace_start(trace_file_opt, start_time);
 
 	/* Prepare argv to start the Spotify client application */
 	if (client_app_args_opt)
@@ -137,51 +189,91 @@ int main(int argc, char **argv)
 	client_app_argv[n_opts + 1] = NULL;
 
 	/* Check if running on X11 and quit if not. */
+	trace_begin("x11 check");
 	display = gdk_display_get_default();
+	trace_end();
 	if (!GDK_IS_X11_DISPLAY(display)) {
+		trace_finish();
 		g_free(client_app_argv[0]);
 		g_critical("No X11 display found. Quitting.");
 		return 2;
 	}
 
+	trace_begin("gtk init");
 	gtk_init(&argc, &argv);
+	stats_monitor_main_loop();
+	trace_end();
 
+	trace_begin("check running");
 	if (tray_dbus_server_check_running(toggle_window)) {
 		g_debug("Another instance of the tray-icon is already running");
+		trace_finish();
 		g_free(client_app_argv[0]);
 		return 0;
 	}
+	trace_end();
+	/* Connect to the player D-Bus interface; this runs in the background
+	 * while the client window is being searched. */
+	trace_begin("player proxy");
+	proxy = proxy_new_proxy(0, player_opt);
+	trace_end();
 	/* Try to find the client application window; spawn a new Spotify
 	 * client eventually. Bail out on failure */
-	get_client_window(&win_client, client_app_argv);
+	trace_begin("find client window");
+	get_client_window(&win_client, proxy->player_name, client_app_argv,
+			(guint) client_timeout_opt, &spawned_pid);
+	trace_end();
 	if (!win_client.window) {
 		g_critical("Could not find the Spotify client window: giving up");
+		trace_finish();
+		proxy_free_proxy(proxy);
 		g_free(client_app_argv[0]);
 		return 1;
 	}
 	if (hide_on_start)
-		gdk_window_hide(win_client.window);
+		winctrl_hide(&win_client);
+	else
+		winctrl_track_client(&win_client);
+
+	trace_begin("watch client");
+	/* Quit when the client exits; if we launched just an intermediate
+	 * process, it only needs to be reaped. */
+	client_is_child = spawned_pid && (spawned_pid == win_client.pid);
+	if (spawned_pid && !client_is_child)
+		client_reap(spawned_pid);
+	proxy_rebind(proxy, win_client.pid, client_is_child);
+	/* In the supervisor mode the tray survives the client exit */
+	if (supervise || relaunch)
+		supervisor = supervisor_new(proxy, &win_client, client_app_argv,
+				(guint) client_timeout_opt, relaunch);
+	trace_end();
 
-	if ((bus_id = tray_dbus_server_new(win_client.window)) == 0) {
+	trace_begin("tray dbus server");
+	if ((bus_id = tray_dbus_server_new(&win_client, proxy)) == 0) {
 		g_critical("Error starting D-Bus server");
 	}
-
-	for (i = 0; i < n_opts + 1; i++)
-		g_free(client_app_argv[i]);
-	g_free(client_app_argv);
-	g_free(client_app_args_opt);
-
-	/* Connect to Spotify D-Bus interface. */
-	proxy = proxy_new_proxy(win_client.pid);
-	if (!proxy)
-		return 2;
+	trace_end();
 	/* Set up the tray status icon */
-	new_tray_icon(proxy, win_client.window, icon_path_opt);
+	if (!headless) {
+		trace_begin("tray icon");
+		new_tray_icon(proxy, &win_client, icon_path_opt, scroll_mode,
+				tooltip_opt);
+		trace_end();
+	}
+	trace_finish();
+	g_free(trace_file_opt);
 	/* Start the main loop */
 	gtk_main();
+	supervisor_free(supervisor);
 	tray_dbus_server_destroy(bus_id);
 	proxy_free_proxy(proxy);
 
+	for (i = 0; i < n_opts + 1; i++)
+		g_free(client_app_argv[i]);
+	g_free(client_app_argv);
+	g_free(client_app_args_opt);
+	g_free(player_opt);
+
 	return 0;
 }
 
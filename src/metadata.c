@@ -0,0 +1,160 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <string.h>
+#include <gio/gio.h>
+#include "proxy.h"
+#include "metadata.h"
+
+/* Decoder of the MPRIS Metadata dictionary: the dictionary is walked once
+ * and every known key is dispatched through a static perfect hash table
+ * straight into its proxy_metadata_t field. Unknown keys and values of
+ * unexpected types are skipped, missing keys leave the field empty. */
+
+enum _metadata_type_e {
+	METADATA_STRING, /* s or o */
+	METADATA_STRING_ARRAY, /* as */
+	METADATA_INT, /* i */
+	METADATA_UINT64, /* t or x */
+	METADATA_FLOAT /* d */
+};
+
+typedef enum _metadata_type_e metadata_type_t;
+
+struct _metadata_key_s {
+	const gchar *key;
+	metadata_type_t type;
+	glong offset; /* of the field in proxy_metadata_t */
+	glong num_offset; /* of the list length, string arrays only */
+};
+
+typedef struct _metadata_key_s metadata_key_t;
+
+#define FIELD(__f) G_STRUCT_OFFSET(proxy_metadata_t, __f)
+
+/* The hash is (length + key[1] + key[7]) % METADATA_HASH_SIZE; it has no
+ * collisions for the keys below, all of them at least 8 characters long.
+ * The table has to be re-checked when a key gets added. */
+#define METADATA_HASH_SIZE 20
+#define METADATA_KEY_MIN_LEN 8
+
+static const metadata_key_t metadata_keys[METADATA_HASH_SIZE] = {
+	[0] = { "xesam:album", METADATA_STRING, FIELD(album), 0 },
+	[2] = { "xesam:discNumber", METADATA_INT, FIELD(disc_number), 0 },
+	[4] = { "xesam:url", METADATA_STRING, FIELD(track_url), 0 },
+	[5] = { "mpris:length", METADATA_UINT64, FIELD(length), 0 },
+	[6] = { "xesam:albumArtist", METADATA_STRING_ARRAY,
+		FIELD(album_artist), FIELD(album_artist_num) },
+	[7] = { "xesam:artist", METADATA_STRING_ARRAY,
+		FIELD(artist), FIELD(artist_num) },
+	[12] = { "xesam:trackNumber", METADATA_INT, FIELD(track_number), 0 },
+	[14] = { "xesam:autoRating", METADATA_FLOAT, FIELD(auto_rating), 0 },
+	[17] = { "xesam:title", METADATA_STRING, FIELD(title), 0 },
+	[18] = { "mpris:artUrl", METADATA_STRING, FIELD(art_url), 0 },
+	[19] = { "mpris:trackid", METADATA_STRING, FIELD(track_id), 0 }
+};
+
+static const metadata_key_t *lookup_key(const gchar *key)
+{
+	const metadata_key_t *entry;
+	gsize len = strlen(key);
+
+	if (len < METADATA_KEY_MIN_LEN)
+		return NULL;
+	entry = &metadata_keys[(len + (guchar) key[1] + (guchar) key[7])
+		% METADATA_HASH_SIZE];
+	if (!entry->key || (strcmp(entry->key, key) != 0))
+		return NULL;
+
+	return entry;
+}
+
+static void decode_value(proxy_metadata_t *metadata,
+		const metadata_key_t *entry, GVariant *value)
+{
+	gpointer field = G_STRUCT_MEMBER_P(metadata, entry->offset);
+	gsize len;
+
+	switch (entry->type) {
+	case METADATA_STRING:
+		if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING) ||
+				g_variant_is_of_type(value, G_VARIANT_TYPE_OBJECT_PATH)) {
+			g_free(*(gchar **)field);
+			*(gchar **)field = g_variant_dup_string(value, NULL);
+		}
+		break;
+	case METADATA_STRING_ARRAY:
+		if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY)) {
+			g_strfreev(*(gchar ***)field);
+			*(gchar ***)field = g_variant_dup_strv(value, &len);
+			G_STRUCT_MEMBER(guint, metadata, entry->num_offset) = len;
+		}
+		break;
+	case METADATA_INT:
+		if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT32))
+			*(gint *)field = g_variant_get_int32(value);
+		break;
+	case METADATA_UINT64:
+		if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64))
+			*(guint64 *)field = g_variant_get_uint64(value);
+		else if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT64))
+			*(guint64 *)field = MAX(g_variant_get_int64(value), 0);
+		break;
+	case METADATA_FLOAT:
+		if (g_variant_is_of_type(value, G_VARIANT_TYPE_DOUBLE))
+			*(gfloat *)field = g_variant_get_double(value);
+		break;
+	}
+}
+
+#define FREE_AND_NULL(__v) do { g_free(__v); __v = NULL; } while(0)
+void metadata_free_values(proxy_metadata_t *metadata)
+{
+	FREE_AND_NULL(metadata->track_id);
+	metadata->length = 0LL;
+	FREE_AND_NULL(metadata->art_url);
+	FREE_AND_NULL(metadata->album);
+	g_strfreev(metadata->album_artist);
+	metadata->album_artist = NULL;
+	metadata->album_artist_num = 0;
+	g_strfreev(metadata->artist);
+	metadata->artist = NULL;
+	metadata->artist_num = 0;
+	metadata->auto_rating = 0.0;
+	metadata->disc_number = 0;
+	FREE_AND_NULL(metadata->title);
+	metadata->track_number = 0;
+	FREE_AND_NULL(metadata->track_url);
+	g_strfreev(metadata->tooltip_markup);
+	metadata->tooltip_markup = NULL;
+}
+
+/* Decode the a{sv} dictionary in a single walk into a scratch copy, which
+ * replaces the metadata if it describes another track (or if force is
+ * set). The track ID is a string for Spotify but an object path according
+ * to MPRIS, both are accepted; a dictionary without one is always a new
+ * track. Returns TRUE if the metadata got replaced. */
+gboolean metadata_update(proxy_metadata_t *metadata, GVariant *data_dict,
+		gboolean force)
+{
+	proxy_metadata_t scratch = { NULL };
+	GVariantIter iter;
+	const gchar *key;
+	GVariant *value;
+	const metadata_key_t *entry;
+
+	g_variant_iter_init(&iter, data_dict);
+	while (g_variant_iter_loop(&iter, "{&sv}", &key, &value))
+		if ((entry = lookup_key(key)))
+			decode_value(&scratch, entry, value);
+	if (!force && scratch.track_id &&
+			(g_strcmp0(scratch.track_id, metadata->track_id) == 0)) {
+		metadata_free_values(&scratch);
+		return FALSE;
+	}
+	metadata_free_values(metadata);
+	*metadata = scratch;
+
+	return TRUE;
+}
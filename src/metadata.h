@@ -0,0 +1,8 @@
+#ifndef _METADATA_H
+#define _METADATA_H
+
+gboolean metadata_update(proxy_metadata_t *metadata, GVariant *data_dict,
+		gboolean force);
+void metadata_free_values(proxy_metadata_t *metadata);
+
+#endif
@@ -0,0 +1,568 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gio/gio.h>
+#include "proxy.h"
+#include "players.h"
+#include "metadata.h"
+#include "stats.h"
+
+/* Registry of all the MPRIS players on the session bus. Instead of a proxy
+ * per player there are just two bus-wide signal subscriptions: the
+ * PropertiesChanged signals of the MPRIS objects, routed to the players by
+ * the sender, and the NameOwnerChanged signals of the MPRIS names. One
+ * connection may own several player names; they all share the objects of
+ * the connection and get its signals. */
+
+#define PLAYERS_OBJECT_PATH "/org/mpris/MediaPlayer2"
+#define PLAYERS_PLAYER_INTERFACE "org.mpris.MediaPlayer2.Player"
+#define DBUS_SERVICE_NAME "org.freedesktop.DBus"
+#define DBUS_OBJECT_PATH "/org/freedesktop/DBus"
+#define DBUS_INTERFACE "org.freedesktop.DBus"
+#define DBUS_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+#define PLAYERS_CALL_TIMEOUT 2000 /* msec */
+
+struct _players_s {
+	GDBusConnection *bus;
+	GHashTable *players; /* bus name -> player_t */
+	GHashTable *owners; /* unique name -> GSList of player_t */
+	guint properties_id;
+	guint owner_changed_id;
+	guint seeked_id;
+	GCancellable *cancellable;
+	players_func_t func;
+	gpointer user_data;
+};
+
+/* The callbacks of a player's calls; the player may be gone meanwhile so
+ * the registry is passed along and the player is looked up by name. */
+struct _player_call_s {
+	players_t *players;
+	gchar *bus_name;
+};
+
+typedef struct _player_call_s player_call_t;
+
+static proxy_playback_status_t parse_playback_status(const gchar *status)
+{
+	if (g_strcmp0(status, "Playing") == 0)
+		return PROXY_STATUS_PLAYING;
+	if (g_strcmp0(status, "Paused") == 0)
+		return PROXY_STATUS_PAUSED;
+	if (g_strcmp0(status, "Stopped") == 0)
+		return PROXY_STATUS_STOPPED;
+	return PROXY_STATUS_UNKNOWN;
+}
+
+static proxy_loop_status_t parse_loop_status(const gchar *loop)
+{
+	if (g_strcmp0(loop, "Track") == 0)
+		return PROXY_LOOP_TRACK;
+	if (g_strcmp0(loop, "Playlist") == 0)
+		return PROXY_LOOP_PLAYLIST;
+	return PROXY_LOOP_NONE;
+}
+
+/* The part of the MPRIS Player interface the tray consumes; the other
+ * properties are dropped as soon as they're received. */
+static GDBusPropertyInfo player_property_metadata = {
+	-1, "Metadata", "a{sv}", G_DBUS_PROPERTY_INFO_FLAGS_READABLE, NULL
+};
+static GDBusPropertyInfo player_property_playback_status = {
+	-1, "PlaybackStatus", "s", G_DBUS_PROPERTY_INFO_FLAGS_READABLE, NULL
+};
+static GDBusPropertyInfo player_property_loop_status = {
+	-1, "LoopStatus", "s", G_DBUS_PROPERTY_INFO_FLAGS_READABLE |
+		G_DBUS_PROPERTY_INFO_FLAGS_WRITABLE, NULL
+};
+static GDBusPropertyInfo player_property_shuffle = {
+	-1, "Shuffle", "b", G_DBUS_PROPERTY_INFO_FLAGS_READABLE |
+		G_DBUS_PROPERTY_INFO_FLAGS_WRITABLE, NULL
+};
+static GDBusPropertyInfo player_property_volume = {
+	-1, "Volume", "d", G_DBUS_PROPERTY_INFO_FLAGS_READABLE |
+		G_DBUS_PROPERTY_INFO_FLAGS_WRITABLE, NULL
+};
+static GDBusPropertyInfo player_property_position = {
+	-1, "Position", "x", G_DBUS_PROPERTY_INFO_FLAGS_READABLE, NULL
+};
+static GDBusPropertyInfo player_property_rate = {
+	-1, "Rate", "d", G_DBUS_PROPERTY_INFO_FLAGS_READABLE |
+		G_DBUS_PROPERTY_INFO_FLAGS_WRITABLE, NULL
+};
+static GDBusPropertyInfo *player_properties[] = {
+	&player_property_metadata,
+	&player_property_playback_status,
+	&player_property_loop_status,
+	&player_property_shuffle,
+	&player_property_volume,
+	&player_property_position,
+	&player_property_rate,
+	NULL
+};
+static GDBusInterfaceInfo player_interface_info = {
+	-1, PLAYERS_PLAYER_INTERFACE, NULL, NULL, player_properties, NULL
+};
+
+/* Store the property value in the player state; properties not consumed or
+ * with unexpected types are ignored. all is set for the initial load.
+ * Returns the proxy_change_e mask. */
+static guint update_property(player_t *player, const gchar *name,
+		GVariant *value, gboolean all)
+{
+	GDBusPropertyInfo *info;
+	proxy_playback_status_t status;
+
+	info = g_dbus_interface_info_lookup_property(&player_interface_info,
+			name);
+	if (!info)
+		return 0;
+	if (!g_variant_is_of_type(value, G_VARIANT_TYPE(info->signature))) {
+		g_warning("Player %s: unexpected type of %s", player->bus_name, name);
+		return 0;
+	}
+	if (info == &player_property_metadata) {
+		/* The metadata get replaced just when the track changes */
+		if (!metadata_update(player->metadata, value, all))
+			return 0;
+		stats_inc(STATS_METADATA_PARSES);
+		/* A new track starts from the beginning; no Seeked is sent */
+		if (!all)
+			proxy_clock_set(&player->clock, 0);
+		return PROXY_CHANGED_METADATA;
+	}
+	if (info == &player_property_playback_status) {
+		status = parse_playback_status(g_variant_get_string(value, NULL));
+		if (status == PROXY_STATUS_PLAYING &&
+				player->state.status != PROXY_STATUS_PLAYING)
+			player->playing_since = g_get_monotonic_time();
+		player->state.status = status;
+		proxy_clock_set_running(&player->clock,
+				status == PROXY_STATUS_PLAYING);
+	} else if (info == &player_property_loop_status) {
+		player->state.loop = parse_loop_status(
+				g_variant_get_string(value, NULL));
+	} else if (info == &player_property_shuffle) {
+		player->state.shuffle = g_variant_get_boolean(value);
+	} else if (info == &player_property_volume) {
+		player->state.volume = g_variant_get_double(value);
+	} else if (info == &player_property_position) {
+		proxy_clock_set(&player->clock, g_variant_get_int64(value));
+	} else if (info == &player_property_rate) {
+		proxy_clock_set_rate(&player->clock, g_variant_get_double(value));
+	}
+
+	return PROXY_CHANGED_STATE;
+}
+
+static guint update_properties(player_t *player, GVariant *properties,
+		gboolean all)
+{
+	GVariantIter iter;
+	const gchar *name;
+	GVariant *value;
+	guint changes = 0;
+
+	g_variant_iter_init(&iter, properties);
+	while (g_variant_iter_loop(&iter, "{&sv}", &name, &value))
+		changes |= update_property(player, name, value, all);
+
+	return changes;
+}
+
+static player_call_t *new_player_call(players_t *players, player_t *player)
+{
+	player_call_t *call = g_malloc(sizeof(player_call_t));
+
+	call->players = players;
+	call->bus_name = g_strdup(player->bus_name);
+
+	return call;
+}
+
+/* Finishes a player call: returns the result and the player, or NULL if
+ * the call failed or the player is gone. */
+static GVariant *finish_player_call(GObject *source, GAsyncResult *res,
+		player_call_t *call, player_t **player)
+{
+	GVariant *result;
+	GError *error = NULL;
+
+	result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+			&error);
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* The player (or the whole registry) is gone */
+		g_error_free(error);
+		*player = NULL;
+	} else {
+		*player = g_hash_table_lookup(call->players->players, call->bus_name);
+		if (error) {
+			g_debug("Player %s call failed: %s", call->bus_name,
+					error->message);
+			g_error_free(error);
+		}
+	}
+	g_free(call->bus_name);
+	g_free(call);
+	if (!*player && result) {
+		g_variant_unref(result);
+		result = NULL;
+	}
+
+	return result;
+}
+
+static void on_properties_loaded(GObject *source, GAsyncResult *res,
+		gpointer user_data)
+{
+	player_t *player;
+	players_t *players = ((player_call_t *) user_data)->players;
+	GVariant *result, *properties;
+
+	if (!(result = finish_player_call(source, res, user_data, &player)))
+		return;
+	properties = g_variant_get_child_value(result, 0);
+	update_properties(player, properties, TRUE);
+	g_variant_unref(properties);
+	g_variant_unref(result);
+	player->ready = TRUE;
+	g_debug("Player %s (%s) is ready", player->bus_name, player->owner);
+	players->func(player, PLAYERS_EVENT_APPEARED, 0, players->user_data);
+}
+
+/* A single GetAll: the state it returns is newer than any signal received
+ * before its reply, so those can be dropped, and no signal can slip in
+ * between the parts of the state. Only the properties of
+ * player_interface_info are kept. */
+static void load_properties(players_t *players, player_t *player)
+{
+	g_dbus_connection_call(players->bus,
+			player->owner,
+			PLAYERS_OBJECT_PATH,
+			DBUS_PROPERTIES_INTERFACE,
+			"GetAll",
+			g_variant_new("(s)", PLAYERS_PLAYER_INTERFACE),
+			G_VARIANT_TYPE("(a{sv})"),
+			G_DBUS_CALL_FLAGS_NO_AUTO_START,
+			PLAYERS_CALL_TIMEOUT,
+			player->cancellable,
+			on_properties_loaded,
+			new_player_call(players, player));
+}
+
+/* The players whose names are owned by the unique name */
+static GSList *get_owned(players_t *players, const gchar *owner)
+{
+	return g_hash_table_lookup(players->owners, owner);
+}
+
+static void set_owner(players_t *players, player_t *player,
+		const gchar *owner)
+{
+	player->owner = g_strdup(owner);
+	/* The key is kept if present, the new copy is freed then */
+	g_hash_table_insert(players->owners, g_strdup(owner),
+			g_slist_prepend(get_owned(players, owner), player));
+	load_properties(players, player);
+}
+
+static void unset_owner(players_t *players, player_t *player)
+{
+	GSList *owned = g_slist_remove(get_owned(players, player->owner), player);
+
+	if (owned)
+		g_hash_table_insert(players->owners, g_strdup(player->owner), owned);
+	else
+		g_hash_table_remove(players->owners, player->owner);
+}
+
+static void on_name_owner(GObject *source, GAsyncResult *res,
+		gpointer user_data)
+{
+	player_t *player;
+	players_t *players;
+	GVariant *result;
+	const gchar *owner;
+
+	players = ((player_call_t *) user_data)->players;
+	if (!(result = finish_player_call(source, res, user_data, &player)))
+		return;
+	g_variant_get(result, "(&s)", &owner);
+	if (!player->owner)
+		set_owner(players, player, owner);
+	g_variant_unref(result);
+}
+
+static gboolean is_player_name(const gchar *name)
+{
+	return g_str_has_prefix(name, PLAYERS_NAMESPACE ".");
+}
+
+/* A player name appeared on the bus; owner is NULL if not known yet */
+static void add_player(players_t *players, const gchar *bus_name,
+		const gchar *owner)
+{
+	player_t *player;
+
+	if (g_hash_table_contains(players->players, bus_name))
+		return;
+	player = g_malloc0(sizeof(player_t));
+	player->bus_name = g_strdup(bus_name);
+	player->metadata = g_malloc0(sizeof(proxy_metadata_t));
+	player->state.status = PROXY_STATUS_UNKNOWN;
+	player->state.volume = -1.0;
+	player->state.loop = PROXY_LOOP_NONE;
+	proxy_clock_init(&player->clock);
+	player->cancellable = g_cancellable_new();
+	g_hash_table_insert(players->players, player->bus_name, player);
+	if (owner) {
+		set_owner(players, player, owner);
+		return;
+	}
+	g_dbus_connection_call(players->bus,
+			DBUS_SERVICE_NAME,
+			DBUS_OBJECT_PATH,
+			DBUS_INTERFACE,
+			"GetNameOwner",
+			g_variant_new("(s)", bus_name),
+			G_VARIANT_TYPE("(s)"),
+			G_DBUS_CALL_FLAGS_NONE,
+			PLAYERS_CALL_TIMEOUT,
+			player->cancellable,
+			on_name_owner,
+			new_player_call(players, player));
+}
+
+static void free_player(player_t *player)
+{
+	g_cancellable_cancel(player->cancellable);
+	g_object_unref(player->cancellable);
+	metadata_free_values(player->metadata);
+	g_free(player->metadata);
+	g_free(player->owner);
+	g_free(player->bus_name);
+	g_free(player);
+}
+
+static void remove_player(players_t *players, const gchar *bus_name)
+{
+	player_t *player = g_hash_table_lookup(players->players, bus_name);
+
+	if (!player)
+		return;
+	g_hash_table_remove(players->players, bus_name);
+	if (player->owner)
+		unset_owner(players, player);
+	g_debug("Player %s has left the bus", bus_name);
+	if (player->ready)
+		players->func(player, PLAYERS_EVENT_VANISHED, 0, players->user_data);
+	free_player(player);
+}
+
+static void on_list_names(GObject *source, GAsyncResult *res,
+		gpointer user_data)
+{
+	players_t *players = user_data;
+	GVariant *result;
+	GVariantIter *iter;
+	const gchar *name;
+	GError *error = NULL;
+
+	result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+			&error);
+	if (!result) {
+		if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_critical("Could not list the bus names: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+	g_variant_get(result, "(as)", &iter);
+	while (g_variant_iter_loop(iter, "&s", &name))
+		if (is_player_name(name))
+			add_player(players, name, NULL);
+	g_variant_iter_free(iter);
+	g_variant_unref(result);
+}
+
+static void on_name_owner_changed(GDBusConnection *connection,
+		const gchar *sender_name, const gchar *object_path,
+		const gchar *interface_name, const gchar *signal_name,
+		GVariant *parameters, gpointer user_data)
+{
+	players_t *players = user_data;
+	const gchar *name, *old_owner, *new_owner;
+
+	g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+	if (!is_player_name(name))
+		return;
+	if (*old_owner)
+		remove_player(players, name);
+	if (*new_owner)
+		add_player(players, name, new_owner);
+}
+
+static void on_properties_changed(GDBusConnection *connection,
+		const gchar *sender_name, const gchar *object_path,
+		const gchar *interface_name, const gchar *signal_name,
+		GVariant *parameters, gpointer user_data)
+{
+	players_t *players = user_data;
+	player_t *player;
+	const gchar *changed_interface;
+	GVariant *changed;
+	GSList *owned;
+	guint changes;
+
+	if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sa{sv}as)")))
+		return;
+	g_variant_get(parameters, "(&s@a{sv}^a&s)", &changed_interface,
+			&changed, NULL);
+	if (g_strcmp0(changed_interface, PLAYERS_PLAYER_INTERFACE) != 0 ||
+			!(owned = get_owned(players, sender_name))) {
+		g_variant_unref(changed);
+		return;
+	}
+	stats_inc(STATS_SIGNALS);
+	for (; owned; owned = owned->next) {
+		player = owned->data;
+		/* Not ready: the properties being loaded are newer anyway */
+		if (!player->ready)
+			continue;
+		changes = update_properties(player, changed, FALSE);
+		if (changes)
+			players->func(player, PLAYERS_EVENT_CHANGED, changes,
+					players->user_data);
+	}
+	g_variant_unref(changed);
+}
+
+/* The position jumped: the only position update besides the track changes */
+static void on_seeked(GDBusConnection *connection,
+		const gchar *sender_name, const gchar *object_path,
+		const gchar *interface_name, const gchar *signal_name,
+		GVariant *parameters, gpointer user_data)
+{
+	players_t *players = user_data;
+	player_t *player;
+	GSList *owned;
+	gint64 position;
+
+	if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(x)")) ||
+			!(owned = get_owned(players, sender_name)))
+		return;
+	stats_inc(STATS_SIGNALS);
+	g_variant_get(parameters, "(x)", &position);
+	for (; owned; owned = owned->next) {
+		player = owned->data;
+		if (!player->ready)
+			continue;
+		proxy_clock_set(&player->clock, position);
+		players->func(player, PLAYERS_EVENT_CHANGED, PROXY_CHANGED_STATE,
+				players->user_data);
+	}
+}
+
+/* Starts tracking the players; func is called for every player once it's
+ * ready and on all its changes. */
+players_t *players_new(GDBusConnection *bus, players_func_t func,
+		gpointer user_data)
+{
+	players_t *players = g_malloc0(sizeof(players_t));
+
+	players->bus = g_object_ref(bus);
+	players->players = g_hash_table_new(g_str_hash, g_str_equal);
+	players->owners = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			NULL);
+	players->cancellable = g_cancellable_new();
+	players->func = func;
+	players->user_data = user_data;
+	players->properties_id = g_dbus_connection_signal_subscribe(bus,
+			NULL, /* any sender */
+			DBUS_PROPERTIES_INTERFACE,
+			"PropertiesChanged",
+			PLAYERS_OBJECT_PATH,
+			PLAYERS_NAMESPACE, /* arg0: the interface */
+			G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
+			on_properties_changed,
+			players,
+			NULL); /* user data free func */
+	players->owner_changed_id = g_dbus_connection_signal_subscribe(bus,
+			DBUS_SERVICE_NAME,
+			DBUS_INTERFACE,
+			"NameOwnerChanged",
+			DBUS_OBJECT_PATH,
+			PLAYERS_NAMESPACE, /* arg0: the name */
+			G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
+			on_name_owner_changed,
+			players,
+			NULL); /* user data free func */
+	players->seeked_id = g_dbus_connection_signal_subscribe(bus,
+			NULL, /* any sender */
+			PLAYERS_PLAYER_INTERFACE,
+			"Seeked",
+			PLAYERS_OBJECT_PATH,
+			NULL, /* arg0 */
+			G_DBUS_SIGNAL_FLAGS_NONE,
+			on_seeked,
+			players,
+			NULL); /* user data free func */
+	/* Subscribed first so that no player can slip through */
+	g_dbus_connection_call(bus,
+			DBUS_SERVICE_NAME,
+			DBUS_OBJECT_PATH,
+			DBUS_INTERFACE,
+			"ListNames",
+			NULL, /* parameters */
+			G_VARIANT_TYPE("(as)"),
+			G_DBUS_CALL_FLAGS_NONE,
+			PLAYERS_CALL_TIMEOUT,
+			players->cancellable,
+			on_list_names,
+			players);
+
+	return players;
+}
+
+void players_free(players_t *players)
+{
+	GHashTableIter iter;
+	gpointer player, owned;
+
+	if (!players)
+		return;
+	g_dbus_connection_signal_unsubscribe(players->bus,
+			players->properties_id);
+	g_dbus_connection_signal_unsubscribe(players->bus,
+			players->owner_changed_id);
+	g_dbus_connection_signal_unsubscribe(players->bus, players->seeked_id);
+	g_cancellable_cancel(players->cancellable);
+	g_object_unref(players->cancellable);
+	g_hash_table_iter_init(&iter, players->players);
+	while (g_hash_table_iter_next(&iter, NULL, &player))
+		free_player(player);
+	g_hash_table_iter_init(&iter, players->owners);
+	while (g_hash_table_iter_next(&iter, NULL, &owned))
+		g_slist_free(owned);
+	g_hash_table_destroy(players->owners);
+	g_hash_table_destroy(players->players);
+	g_object_unref(players->bus);
+	g_free(players);
+}
+
+/* Returns the list of the ready players, free it with g_list_free() */
+GList *players_get_players(players_t *players)
+{
+	GHashTableIter iter;
+	gpointer player;
+	GList *list = NULL;
+
+	if (!players)
+		return NULL;
+	g_hash_table_iter_init(&iter, players->players);
+	while (g_hash_table_iter_next(&iter, NULL, &player))
+		if (((player_t *) player)->ready)
+			list = g_list_prepend(list, player);
+
+	return list;
+}
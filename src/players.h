@@ -0,0 +1,36 @@
+#ifndef _PLAYERS_H
+#define _PLAYERS_H
+
+#define PLAYERS_NAMESPACE "org.mpris.MediaPlayer2"
+
+/* One MPRIS player on the bus */
+struct _player_s {
+	gchar *bus_name; /* org.mpris.MediaPlayer2.* */
+	gchar *owner; /* unique name, NULL until known */
+	gboolean ready; /* the properties have been loaded */
+	proxy_metadata_t *metadata;
+	proxy_state_t state;
+	proxy_clock_t clock;
+	gint64 playing_since; /* monotonic time of the playback start or 0 */
+	GCancellable *cancellable;
+};
+
+enum _players_event_e {
+	PLAYERS_EVENT_APPEARED, /* the player is ready */
+	PLAYERS_EVENT_VANISHED, /* freed after the callback returns */
+	PLAYERS_EVENT_CHANGED
+};
+
+typedef enum _players_event_e players_event_t;
+
+/* Called on a player event; changes is a mask of the proxy_change_e values
+ * for PLAYERS_EVENT_CHANGED, 0 otherwise. */
+typedef void (*players_func_t)(player_t *player, players_event_t event,
+		guint changes, gpointer user_data);
+
+players_t *players_new(GDBusConnection *bus, players_func_t func,
+		gpointer user_data);
+void players_free(players_t *players);
+GList *players_get_players(players_t *players);
+
+#endif
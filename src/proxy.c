@@ -2,13 +2,52 @@
 #include "../config.h"
 #endif
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <gio/gio.h>
+#include <glib-unix.h>
 #include <gtk/gtk.h>
 #include "proxy.h"
+#include "players.h"
+#include "metadata.h"
+#include "stats.h"
 
-#define SPOTIFY_SERVICE_NAME "org.mpris.MediaPlayer2.spotify"
 #define SPOTIFY_OBJECT_PATH "/org/mpris/MediaPlayer2"
 #define SPOTIFY_PLAYER_INTERFACE "org.mpris.MediaPlayer2.Player"
+#define DBUS_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+#define DBUS_SERVICE_NAME "org.freedesktop.DBus"
+#define DBUS_OBJECT_PATH "/org/freedesktop/DBus"
+#define DBUS_INTERFACE "org.freedesktop.DBus"
+#define PROXY_CALL_TIMEOUT 2000 /* msec */
+#define PROXY_CALL_QUEUE_MAX 32
+
+struct _proxy_call_s {
+	const gchar *interface_name;
+	const gchar *method;
+	GVariant *parameters;
+	proxy_call_done_func_t done_func;
+	gpointer user_data;
+	gint64 sent; /* monotonic time */
+};
+
+typedef struct _proxy_call_s proxy_call_t;
+
+struct _proxy_listener_s {
+	proxy_changed_func_t func;
+	gpointer user_data;
+};
+
+typedef struct _proxy_listener_s proxy_listener_t;
+
+struct _proxy_owner_query_s {
+	proxy_t *proxy;
+	gchar *owner;
+};
+
+typedef struct _proxy_owner_query_s proxy_owner_query_t;
 
 static const gchar *proxy_simple_method_name[] = {
 	[PROXY_CALL_PLAY] = "Play",
@@ -19,227 +58,652 @@ static const gchar *proxy_simple_method_name[] = {
 	[PROXY_CALL_STOP] = "Stop"
 };
 
-static gchar *metadata_dup_string(const gchar *key, GVariant *dict)
-{
-	GVariant *varstr;
-	gchar *str;
-	gsize str_len;
-	
-	varstr = g_variant_lookup_value(dict, key, G_VARIANT_TYPE_STRING);
-	str = g_variant_dup_string(varstr, &str_len);
-	g_variant_unref(varstr);
-	
-	return str;
-}	
+static const gchar *proxy_loop_status_name[] = {
+	[PROXY_LOOP_NONE] = "None",
+	[PROXY_LOOP_TRACK] = "Track",
+	[PROXY_LOOP_PLAYLIST] = "Playlist"
+};
 
-static guint64 metadata_get_uint64(const gchar *key, GVariant *dict)
+static void notify_listeners(proxy_t *proxy, guint changes)
 {
-	GVariant *varint;
-	guint64 ret;
+	GSList *l;
+	proxy_listener_t *listener;
 
-	varint = g_variant_lookup_value(dict, key, G_VARIANT_TYPE_UINT64);
-	ret =  g_variant_get_uint64(varint);
-	g_variant_unref(varint);
+	for (l = proxy->listeners; l != NULL; l = l->next) {
+		listener = l->data;
+		listener->func(proxy, changes, listener->user_data);
+	}
+}
 
-	return ret;
+/* Does the player match the preferred player name? Per-profile instances
+ * (the name followed by a suffix) count too. */
+static gboolean is_preferred_player(proxy_t *proxy, player_t *player)
+{
+	const gchar *name = player->bus_name + strlen(PLAYERS_NAMESPACE ".");
+	gsize len = strlen(proxy->player_name);
+
+	if (g_strcmp0(proxy->player_name, "*") == 0)
+		return TRUE;
+	return (strncmp(name, proxy->player_name, len) == 0) &&
+		(name[len] == '\0' || name[len] == '.');
 }
 
-static gint metadata_get_int(const gchar *key, GVariant *dict)
+/* The active player is the preferred one that is playing or has started
+ * playing most recently; the current one wins ties. */
+static player_t *select_active_player(proxy_t *proxy)
 {
-	GVariant *varint;
-	gint ret;
+	GList *players = players_get_players(proxy->players), *l;
+	player_t *player, *best = NULL;
+	gboolean playing, best_playing = FALSE;
 
-	varint = g_variant_lookup_value(dict, key, G_VARIANT_TYPE_INT32);
-	ret = g_variant_get_int32(varint);
-	g_variant_unref(varint);
+	for (l = players; l != NULL; l = l->next) {
+		player = l->data;
+		if (!is_preferred_player(proxy, player))
+			continue;
+		playing = (player->state.status == PROXY_STATUS_PLAYING);
+		if (!best || (playing && !best_playing) ||
+				((playing == best_playing) &&
+				 (player->playing_since > best->playing_since)) ||
+				((playing == best_playing) &&
+				 (player->playing_since == best->playing_since) &&
+				 (player == proxy->active))) {
+			best = player;
+			best_playing = playing;
+		}
+	}
+	g_list_free(players);
 
-	return ret;
+	return best;
+}
+
+static void sync_active_player(proxy_t *proxy)
+{
+	if (proxy->active) {
+		proxy->metadata = proxy->active->metadata;
+		proxy->state = proxy->active->state;
+	} else {
+		proxy->metadata = proxy->no_metadata;
+		proxy->state.status = PROXY_STATUS_UNKNOWN;
+		proxy->state.volume = -1.0;
+		proxy->state.shuffle = FALSE;
+		proxy->state.loop = PROXY_LOOP_NONE;
+	}
 }
 
-static guint metadata_dup_string_array(const gchar *key, GVariant *dict,
-		gchar ***new_array)
-{
-	GVariant *vararray;
-	GVariant *varstr;
-	GVariantIter iter;
-	gsize array_len, str_len;
-	gint i;
-
-	vararray = g_variant_lookup_value(dict, key, G_VARIANT_TYPE_STRING_ARRAY);
-	array_len = g_variant_n_children(vararray);
-	i = 0;
-	*new_array = g_malloc0(sizeof(char *) * array_len);
-	g_variant_iter_init(&iter, vararray);
-	while ((varstr = g_variant_iter_next_value (&iter))) {
-		*new_array[i] = g_variant_dup_string(varstr, &str_len);
-		g_variant_unref(varstr);
-		++i;
-	}
-	g_variant_unref(vararray);
-
-	return array_len;
-}
-
-static void update_metadata(proxy_metadata_t *metadata, GVariant *data_dict)
-{
-	metadata->track_id = metadata_dup_string("mpris:trackid", data_dict);
-	metadata->art_url = metadata_dup_string("mpris:artUrl", data_dict);
-	metadata->album = metadata_dup_string("xesam:album", data_dict);
-	metadata->title = metadata_dup_string("xesam:title", data_dict);
-	metadata->track_url = metadata_dup_string("xesam:url", data_dict);
-	metadata->length = metadata_get_uint64("mpris:length", data_dict);
-	metadata->track_number = metadata_get_int("xesam:trackNumber", data_dict);
-	metadata->disc_number =  metadata_get_int("xesam:discNumber", data_dict);
-	metadata->artist_num = metadata_dup_string_array("xesam:artist",
-			data_dict, &metadata->artist);
-	metadata->album_artist_num = metadata_dup_string_array("xesam:albumArtist",
-			data_dict, &metadata->album_artist);
-}
-
-#define FREE_AND_NULL(__v) do { g_free(__v); __v = NULL; } while(0)
-static void free_metadata_values(proxy_metadata_t *metadata)
-{
-	gint i;
-
-	FREE_AND_NULL(metadata->track_id);
-	metadata->length = 0LL;
-	FREE_AND_NULL(metadata->art_url);
-	FREE_AND_NULL(metadata->album);
-	for (i = 0; i < metadata->album_artist_num; i++)
-		FREE_AND_NULL(metadata->album_artist[i]);
-	FREE_AND_NULL(metadata->album_artist);
-	metadata->album_artist_num = 0;
-	for (i = 0; i < metadata->artist_num; i++)
-		FREE_AND_NULL(metadata->artist[i]);
-	FREE_AND_NULL(metadata->artist);
-	metadata->artist_num = 0;
-	metadata->auto_rating = 0.0;
-	metadata->disc_number = 0;
-	FREE_AND_NULL(metadata->title);
-	metadata->track_number = 0;
-	FREE_AND_NULL(metadata->track_url);
-}
-
-static gboolean update_proxy_metadata(proxy_t *proxy)
+static void on_owner_pid(GObject *source, GAsyncResult *res,
+		gpointer user_data)
 {
+	proxy_owner_query_t *query = user_data;
+	proxy_t *proxy = query->proxy;
 	GVariant *result;
-	gchar *proc_dir_path;
-
-	result = g_dbus_proxy_get_cached_property(proxy->player, "Metadata");
-	if (!result) {
-		g_critical("Failed to retrieve the Metadata property");
-		/* It is possible the Spotify app already exited or is exiting
-		 * lets wait a while and check the proc fs for the pid of the
-		 * Spotify app. If not found, quit. */
-		proc_dir_path = g_strdup_printf(PROCFS_PREFIX "/%d", proxy->pid);
-		g_usleep(5E5);
-		if (!g_file_test(proc_dir_path,
-					G_FILE_TEST_EXISTS | G_FILE_TEST_IS_DIR)) {
-			g_critical("The applicaiton has exited, quitting.");
-			gtk_main_quit();
-		}
-		g_free(proc_dir_path);
-		return FALSE;
+	GError *error = NULL;
+	guint32 pid;
+
+	result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+			&error);
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* The proxy is being freed: do not touch it. */
+		g_error_free(error);
+		g_free(query->owner);
+		g_free(query);
+		return;
 	}
-	if (!g_variant_is_of_type(result, G_VARIANT_TYPE_VARDICT)){
+	if (result) {
+		g_variant_get(result, "(u)", &pid);
+		if (proxy->watch_client_owner && !proxy->client_owner &&
+				((GPid) pid == proxy->pid)) {
+			g_debug("Following the client by its bus name %s", query->owner);
+			proxy->client_owner = query->owner;
+			query->owner = NULL;
+		}
 		g_variant_unref(result);
-		g_critical("Unexpected metadata format");
-		return FALSE;
+	} else {
+		g_error_free(error);
 	}
-	free_metadata_values(proxy->metadata);
-	update_metadata(proxy->metadata, result);
-	g_variant_unref(result);
-
-	return TRUE;
+	g_free(query->owner);
+	g_free(query);
 }
 
+/* Find out whether the player belongs to the client process. Without its
+ * PID the first preferred player is taken for the client's. */
+static void check_client_owner(proxy_t *proxy, player_t *player)
+{
+	proxy_owner_query_t *query;
+
+	if (!proxy->watch_client_owner || proxy->client_owner || !player->owner)
+		return;
+	if (proxy->pid <= 0) {
+		if (!is_preferred_player(proxy, player))
+			return;
+		g_debug("Following the client by its bus name %s", player->owner);
+		proxy->client_owner = g_strdup(player->owner);
+		return;
+	}
+	query = g_malloc(sizeof(proxy_owner_query_t));
+	query->proxy = proxy;
+	query->owner = g_strdup(player->owner);
+	g_dbus_connection_call(proxy->bus,
+			DBUS_SERVICE_NAME,
+			DBUS_OBJECT_PATH,
+			DBUS_INTERFACE,
+			"GetConnectionUnixProcessID",
+			g_variant_new("(s)", player->owner),
+			G_VARIANT_TYPE("(u)"),
+			G_DBUS_CALL_FLAGS_NONE,
+			PROXY_CALL_TIMEOUT,
+			proxy->cancellable,
+			on_owner_pid,
+			query);
+}
 
-/* Returns new metadata -- the values might be empty/NULL on proxy error.
- * The metadate might be NULL on memory allocation error. */
-static proxy_metadata_t *create_proxy_metadata(proxy_t *proxy)
+/* Follow the player changes: switch the active player if needed and pass
+ * its changes to the listeners. */
+static void on_players_event(player_t *player, players_event_t event,
+		guint changes, gpointer user_data)
 {
-	if (!(proxy->metadata = g_malloc0(sizeof(proxy_metadata_t)))) {
-		g_critical("Could not allocate memory for the metadata struct");
-		return NULL;
+	proxy_t *proxy = PROXY_T(user_data);
+	player_t *active = proxy->active;
+
+	if ((event != PLAYERS_EVENT_CHANGED) || (changes & PROXY_CHANGED_STATE))
+		active = select_active_player(proxy);
+	if (active != proxy->active) {
+		g_debug("Active player: %s", active ? active->bus_name : "none");
+		proxy->active = active;
+		sync_active_player(proxy);
+		notify_listeners(proxy, PROXY_CHANGED_METADATA | PROXY_CHANGED_STATE);
+	} else if ((event == PLAYERS_EVENT_CHANGED) && (player == active)) {
+		sync_active_player(proxy);
+		notify_listeners(proxy, changes);
 	}
-	if (!update_proxy_metadata(proxy)) {
-		g_critical("Failed to update metadata");
+	if (event == PLAYERS_EVENT_APPEARED) {
+		check_client_owner(proxy, player);
+	} else if ((event == PLAYERS_EVENT_VANISHED) && proxy->client_owner &&
+			(g_strcmp0(player->owner, proxy->client_owner) == 0)) {
+		/* The client left the bus: the best sign of its exit there is */
+		g_debug("Client process %d left the bus", proxy->pid);
+		g_free(proxy->client_owner);
+		proxy->client_owner = NULL;
+		proxy->watch_client_owner = FALSE;
+		proxy_client_exited(proxy);
 	}
+}
 
-	return proxy->metadata;
+/* The player the calls go to: the active one, or the preferred name if
+ * there is none at the moment. */
+static const gchar *get_player_bus_name(proxy_t *proxy)
+{
+	if (proxy->active)
+		return proxy->active->bus_name;
+	return proxy->default_bus_name;
 }
 
 static void free_metadata(proxy_metadata_t *metadata)
 {
-	free_metadata_values(metadata);
+	metadata_free_values(metadata);
 	g_free(metadata);
 	metadata = NULL;
 }
 
-void proxy_simple_method_call(proxy_t *proxy, proxy_simple_call_t call_num)
+static void free_call(proxy_call_t *call)
 {
+	if (call->parameters)
+		g_variant_unref(call->parameters);
+	g_free(call);
+}
+
+static void send_next_call(proxy_t *proxy);
+
+static void on_call_finished(GObject *source, GAsyncResult *res,
+		gpointer user_data)
+{
+	proxy_t *proxy = PROXY_T(user_data);
+	proxy_call_t *call;
+	GVariant *result;
 	GError *error = NULL;
 
-	g_dbus_proxy_call_sync (proxy->player,
-			proxy_simple_method_name[call_num],
-			NULL,
-			G_DBUS_CALL_FLAGS_NONE,
-			-1,
-			NULL,
+	result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
 			&error);
-	if (error)
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* The proxy is being freed: do not touch it. */
+		g_error_free(error);
+		return;
+	}
+	call = g_queue_pop_head(proxy->calls);
+	proxy->call_in_flight = FALSE;
+	stats_record_call_latency(g_get_monotonic_time() - call->sent);
+	if (error) {
+		stats_inc(STATS_CALL_FAILURES);
 		g_critical("D-Bus method '%s' call failed: %s",
-				proxy_simple_method_name[call_num], error->message);
+				call->method, error->message);
+	}
+	if (call->done_func)
+		call->done_func(proxy, call->method, error, call->user_data);
+	if (result)
+		g_variant_unref(result);
+	if (error)
+		g_error_free(error);
+	free_call(call);
+	send_next_call(proxy);
 }
 
-static void *on_properties_changed(GDBusProxy *dbus_proxy,
-		GVariant *changed_properties, const gchar* const  *invalidated_properties,
-		proxy_t *proxy)
+/* Send the call at the head of the queue unless one is already waiting for
+ * the reply: the calls are delivered to the player in order. */
+static void send_next_call(proxy_t *proxy)
 {
-	if (!proxy->metadata)
-		return NULL;
-	update_proxy_metadata(proxy);
+	proxy_call_t *call;
 
-	return NULL;
+	/* Without the bus connection the calls wait for it */
+	if (!proxy->bus || proxy->call_in_flight ||
+			!(call = g_queue_peek_head(proxy->calls)))
+		return;
+	proxy->call_in_flight = TRUE;
+	call->sent = g_get_monotonic_time();
+	stats_inc(STATS_CALLS);
+	g_dbus_connection_call(proxy->bus,
+			get_player_bus_name(proxy),
+			SPOTIFY_OBJECT_PATH,
+			call->interface_name,
+			call->method,
+			call->parameters,
+			NULL, /* reply type */
+			G_DBUS_CALL_FLAGS_NO_AUTO_START,
+			PROXY_CALL_TIMEOUT,
+			proxy->cancellable,
+			on_call_finished,
+			proxy);
 }
 
-proxy_t *proxy_new_proxy(GPid app_pid)
+/* Queue a method call to the player and return immediately. The queue is
+ * bounded: when the player stops answering, new calls are rejected instead
+ * of piling up. The done_func (if any) is always called, possibly even
+ * before this function returns; the calls pending when the proxy is freed
+ * get G_IO_ERROR_CANCELLED and must not queue new ones. */
+void proxy_method_call(proxy_t *proxy, const gchar *interface_name,
+		const gchar *method, GVariant *parameters,
+		proxy_call_done_func_t done_func, gpointer user_data)
 {
-	GDBusProxy *player_proxy;
-	proxy_t *ret = NULL;
+	proxy_call_t *call;
 	GError *error = NULL;
 
-	player_proxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SESSION,
-			G_DBUS_PROXY_FLAGS_NONE,
-			NULL, /* GDBusInterfaceInfo* */
-			SPOTIFY_SERVICE_NAME,
-			SPOTIFY_OBJECT_PATH,
+	if (g_queue_get_length(proxy->calls) >= PROXY_CALL_QUEUE_MAX) {
+		g_set_error(&error, G_IO_ERROR, G_IO_ERROR_BUSY,
+				"Too many calls pending, the player is not responding");
+		stats_inc(STATS_CALL_FAILURES);
+		g_critical("D-Bus method '%s' call failed: %s", method, error->message);
+		if (done_func)
+			done_func(proxy, method, error, user_data);
+		g_error_free(error);
+		if (parameters)
+			g_variant_unref(g_variant_ref_sink(parameters));
+		return;
+	}
+	call = g_malloc(sizeof(proxy_call_t));
+	call->interface_name = interface_name;
+	call->method = method;
+	call->parameters = parameters ? g_variant_ref_sink(parameters) : NULL;
+	call->done_func = done_func;
+	call->user_data = user_data;
+	g_queue_push_tail(proxy->calls, call);
+	send_next_call(proxy);
+}
+
+/* Number of the calls that can be queued before they start to be
+ * rejected */
+guint proxy_get_free_call_slots(proxy_t *proxy)
+{
+	guint queued = g_queue_get_length(proxy->calls);
+
+	return queued < PROXY_CALL_QUEUE_MAX ? PROXY_CALL_QUEUE_MAX - queued : 0;
+}
+
+void proxy_simple_method_call(proxy_t *proxy, proxy_simple_call_t call_num)
+{
+	proxy_method_call(proxy,
 			SPOTIFY_PLAYER_INTERFACE,
-			NULL, /* GCancellable */
-			&error);
-	if (error) {
-		g_critical("Could not connect to Spotify client player D-Bus: %s",
+			proxy_simple_method_name[call_num],
+			NULL, /* parameters */
+			NULL, /* done func */
+			NULL); /* user data */
+}
+
+/* Register a function to be called whenever the player properties change;
+ * the listeners stay registered for the proxy lifetime. */
+void proxy_add_changed_func(proxy_t *proxy, proxy_changed_func_t func,
+		gpointer user_data)
+{
+	proxy_listener_t *listener = g_malloc(sizeof(proxy_listener_t));
+
+	listener->func = func;
+	listener->user_data = user_data;
+	proxy->listeners = g_slist_append(proxy->listeners, listener);
+}
+
+void proxy_clock_init(proxy_clock_t *clock)
+{
+	clock->position = -1;
+	clock->anchor = 0;
+	clock->rate = 1.0;
+	clock->running = FALSE;
+}
+
+/* Returns the current position in microseconds, negative if unknown */
+gint64 proxy_clock_get(const proxy_clock_t *clock)
+{
+	if (clock->position < 0 || !clock->running)
+		return clock->position;
+	return clock->position +
+		(gint64) ((g_get_monotonic_time() - clock->anchor) * clock->rate);
+}
+
+/* Seed or correct the position: it's valid at this moment */
+void proxy_clock_set(proxy_clock_t *clock, gint64 position)
+{
+	clock->position = position;
+	clock->anchor = g_get_monotonic_time();
+}
+
+/* Start or stop the extrapolation; the position reached is kept */
+void proxy_clock_set_running(proxy_clock_t *clock, gboolean running)
+{
+	if (clock->running == running)
+		return;
+	proxy_clock_set(clock, proxy_clock_get(clock));
+	clock->running = running;
+}
+
+void proxy_clock_set_rate(proxy_clock_t *clock, gdouble rate)
+{
+	proxy_clock_set(clock, proxy_clock_get(clock));
+	clock->rate = rate;
+}
+
+/* Returns the playback position (in microseconds) of the active player,
+ * negative if unknown. No D-Bus call is made. */
+gint64 proxy_get_position(proxy_t *proxy)
+{
+	gint64 position;
+
+	if (!proxy->active ||
+			(position = proxy_clock_get(&proxy->active->clock)) < 0)
+		return -1;
+	/* The player reports the next track a bit late */
+	if (proxy->metadata->length > 0 &&
+			position > (gint64) proxy->metadata->length)
+		return (gint64) proxy->metadata->length;
+
+	return position;
+}
+
+/* Returns the time left (in microseconds) of the track, negative if
+ * unknown */
+gint64 proxy_get_remaining(proxy_t *proxy)
+{
+	gint64 position = proxy_get_position(proxy);
+
+	if (position < 0 || proxy->metadata->length == 0)
+		return -1;
+
+	return (gint64) proxy->metadata->length - position;
+}
+
+/* Seek by the offset (in microseconds) relative to the current position */
+void proxy_seek(proxy_t *proxy, gint64 offset)
+{
+	proxy_method_call(proxy,
+			SPOTIFY_PLAYER_INTERFACE,
+			"Seek",
+			g_variant_new("(x)", offset),
+			NULL, /* done func */
+			NULL); /* user data */
+}
+
+/* Returns the last known volume (0.0 -- 1.0), negative if unknown */
+gdouble proxy_get_volume(proxy_t *proxy)
+{
+	return proxy->state.volume;
+}
+
+static void set_player_property(proxy_t *proxy, const gchar *name,
+		GVariant *value)
+{
+	proxy_method_call(proxy,
+			DBUS_PROPERTIES_INTERFACE,
+			"Set",
+			g_variant_new("(ssv)", SPOTIFY_PLAYER_INTERFACE, name, value),
+			NULL, /* done func */
+			NULL); /* user data */
+}
+
+void proxy_set_volume(proxy_t *proxy, gdouble volume)
+{
+	set_player_property(proxy, "Volume",
+			g_variant_new_double(CLAMP(volume, 0.0, 1.0)));
+}
+
+void proxy_set_shuffle(proxy_t *proxy, gboolean shuffle)
+{
+	set_player_property(proxy, "Shuffle", g_variant_new_boolean(shuffle));
+}
+
+void proxy_set_loop(proxy_t *proxy, proxy_loop_status_t loop)
+{
+	set_player_property(proxy, "LoopStatus",
+			g_variant_new_string(proxy_loop_status_name[loop]));
+}
+
+static gint open_pidfd(GPid pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Let the exit function decide what happens next; the player registry
+ * forgets the client's track once its name leaves the bus. */
+void proxy_client_exited(proxy_t *proxy)
+{
+	if (!proxy->exit_func) {
+		g_critical("The application has exited, quitting.");
+		gtk_main_quit();
+		return;
+	}
+	proxy->exit_func(proxy, proxy->exit_data);
+}
+
+/* The pidfd becomes readable when the process exits */
+static gboolean on_pidfd_readable(gint fd, GIOCondition condition,
+		gpointer user_data)
+{
+	proxy_t *proxy = PROXY_T(user_data);
+
+	g_debug("Client process %d exited", proxy->pid);
+	proxy->client_watch_id = 0;
+	close(proxy->pidfd);
+	proxy->pidfd = -1;
+	if (proxy->client_is_child) {
+		waitpid((pid_t) proxy->pid, NULL, WNOHANG);
+		g_spawn_close_pid(proxy->pid);
+	}
+	proxy_client_exited(proxy);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void on_client_child_exit(GPid pid, gint status, gpointer user_data)
+{
+	proxy_t *proxy = PROXY_T(user_data);
+
+	g_debug("Client process %d exited", pid);
+	proxy->client_watch_id = 0;
+	g_spawn_close_pid(pid);
+	proxy_client_exited(proxy);
+}
+
+static void unwatch_client(proxy_t *proxy)
+{
+	if (proxy->client_watch_id) {
+		g_source_remove(proxy->client_watch_id);
+		proxy->client_watch_id = 0;
+	}
+	if (proxy->pidfd >= 0) {
+		close(proxy->pidfd);
+		proxy->pidfd = -1;
+	}
+	proxy->watch_client_owner = FALSE;
+	g_free(proxy->client_owner);
+	proxy->client_owner = NULL;
+}
+
+/* Get notified from the main loop as soon as the client process exits:
+ * through a pidfd, which is immune to the PID reuse, or with a child watch
+ * if the pidfd is not available and the client is our child (is_child).
+ * Otherwise (kernels older than 5.3, or the PID is unknown) the client's
+ * MPRIS player leaving the bus counts as the exit. */
+gboolean proxy_watch_client(proxy_t *proxy, gboolean is_child)
+{
+	GList *players, *l;
+
+	unwatch_client(proxy);
+	if (proxy->pid <= 0) {
+		g_message("The client process is unknown, following its player "
+				"on the bus");
+		goto watch_owner;
+	}
+	proxy->client_is_child = is_child;
+	if ((proxy->pidfd = open_pidfd(proxy->pid)) >= 0) {
+		proxy->client_watch_id = g_unix_fd_add(proxy->pidfd, G_IO_IN,
+				on_pidfd_readable, proxy);
+		return TRUE;
+	}
+	if (is_child) {
+		proxy->client_watch_id = g_child_watch_add(proxy->pid,
+				on_client_child_exit, proxy);
+		return TRUE;
+	}
+	g_message("Cannot watch the client process %d (%s), following its "
+			"player on the bus instead", proxy->pid, g_strerror(errno));
+watch_owner:
+	proxy->watch_client_owner = TRUE;
+	/* The active player first; the ones appearing later are checked as
+	 * they come */
+	if (proxy->active)
+		check_client_owner(proxy, proxy->active);
+	players = players_get_players(proxy->players);
+	for (l = players; l != NULL; l = l->next)
+		check_client_owner(proxy, l->data);
+	g_list_free(players);
+
+	return TRUE;
+}
+
+void proxy_set_exit_func(proxy_t *proxy, proxy_exit_func_t func,
+		gpointer user_data)
+{
+	proxy->exit_func = func;
+	proxy->exit_data = user_data;
+}
+
+/* Switch to a new client process. The player registry picks up the new
+ * player on its own. */
+void proxy_rebind(proxy_t *proxy, GPid app_pid, gboolean is_child)
+{
+	proxy->pid = app_pid;
+	proxy_watch_client(proxy, is_child);
+}
+
+static void on_bus_ready(GObject *source, GAsyncResult *res,
+		gpointer user_data)
+{
+	proxy_t *proxy = PROXY_T(user_data);
+	GDBusConnection *bus;
+	GError *error = NULL;
+
+	bus = g_bus_get_finish(res, &error);
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* The proxy is being freed: do not touch it. */
+		g_error_free(error);
+		return;
+	}
+	if (!bus) {
+		g_critical("Could not connect to the session bus: %s",
 				error->message);
-		goto error;
+		g_error_free(error);
+		return;
 	}
-	ret = g_malloc(sizeof(proxy_t));
-	ret->player = player_proxy;
+	proxy->bus = bus;
+	proxy->players = players_new(bus, on_players_event, proxy);
+	send_next_call(proxy);
+}
+
+/* Creates the proxy controlling the preferred player (the name following
+ * "org.mpris.MediaPlayer2.", or "*" for any). Nothing blocks: the bus
+ * connection and the players are set up in the background, the calls
+ * made meanwhile are queued. */
+proxy_t *proxy_new_proxy(GPid app_pid, const gchar *player_name)
+{
+	proxy_t *ret = g_malloc0(sizeof(proxy_t));
+
+	ret->bus = NULL;
+	ret->players = NULL;
+	ret->player_name = g_strdup(player_name ?
+			player_name : PROXY_DEFAULT_PLAYER);
+	ret->default_bus_name = g_strconcat(PLAYERS_NAMESPACE ".",
+			g_strcmp0(ret->player_name, "*") == 0 ?
+			PROXY_DEFAULT_PLAYER : ret->player_name, NULL);
+	ret->no_metadata = g_malloc0(sizeof(proxy_metadata_t));
 	ret->pid = app_pid;
-	create_proxy_metadata(ret);
-	g_signal_connect(player_proxy, "g-properties-changed",
-			G_CALLBACK(on_properties_changed), ret);
+	ret->calls = g_queue_new();
+	ret->call_in_flight = FALSE;
+	ret->cancellable = g_cancellable_new();
+	ret->listeners = NULL;
+	ret->pidfd = -1;
+	ret->client_watch_id = 0;
+	ret->client_is_child = FALSE;
+	ret->watch_client_owner = FALSE;
+	ret->client_owner = NULL;
+	ret->exit_func = NULL;
+	ret->exit_data = NULL;
+	sync_active_player(ret);
+	g_bus_get(G_BUS_TYPE_SESSION, ret->cancellable, on_bus_ready, ret);
+
 	return ret;
-error:
-	g_object_unref(player_proxy);
-	return NULL;
+}
+
+/* Let the callers of the pending calls know they are not going anywhere */
+static void cancel_calls(proxy_t *proxy)
+{
+	proxy_call_t *call;
+	GError *error;
+
+	error = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED,
+			"The player proxy is being freed");
+	while ((call = g_queue_pop_head(proxy->calls))) {
+		if (call->done_func)
+			call->done_func(proxy, call->method, error, call->user_data);
+		free_call(call);
+	}
+	g_error_free(error);
 }
 
 void proxy_free_proxy(proxy_t *proxy)
 {
 	if (!proxy)
 		return;
-	g_object_unref(proxy->player);
-	free_metadata(proxy->metadata);
+	unwatch_client(proxy);
+	g_cancellable_cancel(proxy->cancellable);
+	g_object_unref(proxy->cancellable);
+	cancel_calls(proxy);
+	g_queue_free(proxy->calls);
+	g_slist_free_full(proxy->listeners, g_free);
+	players_free(proxy->players);
+	if (proxy->bus)
+		g_object_unref(proxy->bus);
+	free_metadata(proxy->no_metadata);
+	g_free(proxy->default_bus_name);
+	g_free(proxy->player_name);
 	g_free(proxy);
 	proxy = NULL;
 }
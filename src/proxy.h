@@ -1,7 +1,7 @@
 #ifndef _SPOTIFY_PROXY_H
 #define _SPOTIFY_PROXY_H
 
-#define PROCFS_PREFIX "/proc"
+#define PROXY_DEFAULT_PLAYER "spotify"
 
 struct _proxy_metadata_s {
 	gchar *track_id;
@@ -17,20 +17,101 @@ struct _proxy_metadata_s {
 	gchar *title;
 	gint track_number;
 	gchar *track_url;
+	/* Rendered tooltip for the track, split at the playback time
+	 * placeholders; set by the tray icon. */
+	gchar **tooltip_markup;
 };
 
 typedef struct _proxy_metadata_s proxy_metadata_t;
 
+enum _proxy_playback_status_e {
+	PROXY_STATUS_UNKNOWN,
+	PROXY_STATUS_PLAYING,
+	PROXY_STATUS_PAUSED,
+	PROXY_STATUS_STOPPED
+};
+
+typedef enum _proxy_playback_status_e proxy_playback_status_t;
+
+enum _proxy_loop_status_e {
+	PROXY_LOOP_NONE,
+	PROXY_LOOP_TRACK,
+	PROXY_LOOP_PLAYLIST
+};
+
+typedef enum _proxy_loop_status_e proxy_loop_status_t;
+
+/* Player properties other than metadata, kept up to date from the
+ * PropertiesChanged signals */
+struct _proxy_state_s {
+	proxy_playback_status_t status;
+	gdouble volume; /* negative if unknown */
+	gboolean shuffle;
+	proxy_loop_status_t loop;
+};
+
+typedef struct _proxy_state_s proxy_state_t;
+
+/* The playback position, extrapolated from the last reported one with the
+ * monotonic clock; corrected just on the player events, never polled. */
+struct _proxy_clock_s {
+	gint64 position; /* usec at the anchor time, negative if unknown */
+	gint64 anchor; /* monotonic time of the position */
+	gdouble rate; /* the player's Rate */
+	gboolean running; /* the playback is on */
+};
+
+typedef struct _proxy_clock_s proxy_clock_t;
+
+typedef struct _players_s players_t;
+typedef struct _player_s player_t;
+typedef struct _proxy_s proxy_t;
+
+/* Called after a change of the player properties; changes is a mask of
+ * the proxy_change_e values. */
+typedef void (*proxy_changed_func_t)(proxy_t *proxy, guint changes,
+		gpointer user_data);
+
+/* Called when the client process exits */
+typedef void (*proxy_exit_func_t)(proxy_t *proxy, gpointer user_data);
+
+/* Called once the player has answered a queued method call; error is NULL
+ * on success, G_IO_ERROR_CANCELLED if the proxy got freed first. */
+typedef void (*proxy_call_done_func_t)(proxy_t *proxy, const gchar *method,
+		const GError *error, gpointer user_data);
+
 struct _proxy_s {
 	GPid pid;
-	GDBusProxy *player;
+	GDBusConnection *bus;
+	players_t *players;
+	gchar *player_name; /* the preferred player, "*" for any */
+	gchar *default_bus_name; /* called while there's no active player */
+	player_t *active; /* the controlled player, NULL if none */
+	/* The active player's metadata and state */
 	proxy_metadata_t *metadata;
-
+	proxy_state_t state;
+	proxy_metadata_t *no_metadata; /* used without an active player */
+	GQueue *calls; /* outgoing calls, the head one is being sent */
+	gboolean call_in_flight;
+	GCancellable *cancellable;
+	GSList *listeners;
+	/* Client process exit detection */
+	gint pidfd;
+	guint client_watch_id;
+	gboolean client_is_child;
+	gboolean watch_client_owner; /* no pidfd or PID: follow the bus name */
+	gchar *client_owner; /* the unique name of the client's player */
+	proxy_exit_func_t exit_func; /* NULL: quit the tray */
+	gpointer exit_data;
 };
 
-typedef struct _proxy_s proxy_t;
 #define PROXY_T(__o) ((proxy_t *)(__o))
 
+enum _proxy_change_e {
+	PROXY_CHANGED_METADATA = 1 << 0, /* new track */
+	PROXY_CHANGED_STATE = 1 << 1 /* any of proxy_state_t or the position */
+};
+
 enum _proxy_simple_call_e {
 	PROXY_CALL_PLAY,
 	PROXY_CALL_PAUSE,
@@ -42,8 +123,31 @@ enum _proxy_simple_call_e {
 
 typedef enum _proxy_simple_call_e proxy_simple_call_t;
 
-proxy_t *proxy_new_proxy(GPid app_pid);
+proxy_t *proxy_new_proxy(GPid app_pid, const gchar *player_name);
 void proxy_free_proxy(proxy_t *proxy);
+gboolean proxy_watch_client(proxy_t *proxy, gboolean is_child);
+void proxy_set_exit_func(proxy_t *proxy, proxy_exit_func_t func,
+		gpointer user_data);
+void proxy_rebind(proxy_t *proxy, GPid app_pid, gboolean is_child);
+void proxy_client_exited(proxy_t *proxy);
 void proxy_simple_method_call(proxy_t *proxy, proxy_simple_call_t call_num);
+guint proxy_get_free_call_slots(proxy_t *proxy);
+void proxy_add_changed_func(proxy_t *proxy, proxy_changed_func_t func,
+		gpointer user_data);
+gint64 proxy_get_position(proxy_t *proxy);
+gint64 proxy_get_remaining(proxy_t *proxy);
+void proxy_clock_init(proxy_clock_t *clock);
+gint64 proxy_clock_get(const proxy_clock_t *clock);
+void proxy_clock_set(proxy_clock_t *clock, gint64 position);
+void proxy_clock_set_running(proxy_clock_t *clock, gboolean running);
+void proxy_clock_set_rate(proxy_clock_t *clock, gdouble rate);
+void proxy_seek(proxy_t *proxy, gint64 offset);
+gdouble proxy_get_volume(proxy_t *proxy);
+void proxy_set_volume(proxy_t *proxy, gdouble volume);
+void proxy_set_shuffle(proxy_t *proxy, gboolean shuffle);
+void proxy_set_loop(proxy_t *proxy, proxy_loop_status_t loop);
+void proxy_method_call(proxy_t *proxy, const gchar *interface_name,
+		const gchar *method, GVariant *parameters,
+		proxy_call_done_func_t done_func, gpointer user_data);
 
 #endif
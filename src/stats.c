@@ -0,0 +1,125 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <glib.h>
+#include "stats.h"
+
+/* Runtime counters of the tray. Everything is updated from the main thread
+ * only. */
+
+#define STATS_LATENCY_BUCKETS 13 /* the last one has no upper bound */
+#define STATS_LATENCY_FIRST_BOUND 1000 /* usec, doubled for every bucket */
+#define STATS_STALL_THRESHOLD 50000 /* usec */
+
+static const gchar *stats_counter_names[] = {
+	[STATS_SIGNALS] = "SignalsReceived",
+	[STATS_METADATA_PARSES] = "MetadataParses",
+	[STATS_CALLS] = "CallsSent",
+	[STATS_CALL_FAILURES] = "CallFailures",
+	[STATS_X_ROUND_TRIPS] = "XRoundTrips",
+	[STATS_XCB_REQUESTS] = "XcbRequests",
+	[STATS_LOOP_WAKEUPS] = "LoopWakeups",
+	[STATS_LOOP_STALLS] = "LoopStalls",
+	[STATS_TIMER_FIRES] = "TimerFires"
+};
+
+static guint64 counters[STATS_COUNTER_NUM];
+static guint64 call_latency[STATS_LATENCY_BUCKETS];
+
+static GPollFunc default_poll_func = NULL;
+static gint64 dispatch_start = 0;
+
+void stats_add(stats_counter_t counter, guint64 n)
+{
+	counters[counter] += n;
+}
+
+guint64 stats_get(stats_counter_t counter)
+{
+	return counters[counter];
+}
+
+const gchar *stats_counter_name(stats_counter_t counter)
+{
+	return stats_counter_names[counter];
+}
+
+void stats_record_call_latency(gint64 usec)
+{
+	gint64 bound = STATS_LATENCY_FIRST_BOUND;
+	guint i;
+
+	for (i = 0; i < STATS_LATENCY_BUCKETS - 1; i++, bound *= 2)
+		if (usec < bound)
+			break;
+	call_latency[i]++;
+}
+
+/* Call latency histogram: counts of the calls per bucket */
+GVariant *stats_get_call_latency(void)
+{
+	return g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, call_latency,
+			STATS_LATENCY_BUCKETS, sizeof(guint64));
+}
+
+/* Upper bounds (exclusive, in usec) of the call latency histogram buckets
+ * but the last, unbounded, one */
+GVariant *stats_get_call_latency_bounds(void)
+{
+	guint64 bounds[STATS_LATENCY_BUCKETS - 1];
+	guint i;
+
+	bounds[0] = STATS_LATENCY_FIRST_BOUND;
+	for (i = 1; i < STATS_LATENCY_BUCKETS - 1; i++)
+		bounds[i] = bounds[i - 1] * 2;
+
+	return g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, bounds,
+			STATS_LATENCY_BUCKETS - 1, sizeof(guint64));
+}
+
+/* All the statistics as a{sv} */
+GVariant *stats_to_variant(void)
+{
+	GVariantBuilder builder;
+	guint i;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+	for (i = 0; i < STATS_COUNTER_NUM; i++)
+		g_variant_builder_add(&builder, "{sv}", stats_counter_names[i],
+				g_variant_new_uint64(counters[i]));
+	g_variant_builder_add(&builder, "{sv}", "CallLatency",
+			stats_get_call_latency());
+	g_variant_builder_add(&builder, "{sv}", "CallLatencyBounds",
+			stats_get_call_latency_bounds());
+
+	return g_variant_builder_end(&builder);
+}
+
+/* Wraps the main context poll: the time between two polls is the time
+ * spent dispatching the events. */
+static gint monitor_poll(GPollFD *ufds, guint nfds, gint timeout)
+{
+	gint ret;
+
+	if (dispatch_start &&
+			(g_get_monotonic_time() - dispatch_start > STATS_STALL_THRESHOLD))
+		counters[STATS_LOOP_STALLS]++;
+	ret = default_poll_func(ufds, nfds, timeout);
+	if (timeout != 0)
+		counters[STATS_LOOP_WAKEUPS]++;
+	dispatch_start = g_get_monotonic_time();
+
+	return ret;
+}
+
+/* Start counting the wakeups and stalls of the default main loop */
+void stats_monitor_main_loop(void)
+{
+	GMainContext *context = g_main_context_default();
+
+	if (default_poll_func)
+		return;
+	default_poll_func = g_main_context_get_poll_func(context);
+	g_main_context_set_poll_func(context, monitor_poll);
+}
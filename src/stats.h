@@ -0,0 +1,29 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+enum _stats_counter_e {
+	STATS_SIGNALS, /* PropertiesChanged signals received */
+	STATS_METADATA_PARSES,
+	STATS_CALLS, /* outgoing D-Bus method calls */
+	STATS_CALL_FAILURES,
+	STATS_X_ROUND_TRIPS, /* spent in the window scans */
+	STATS_XCB_REQUESTS, /* X requests sent through XCB, see winctrl.c */
+	STATS_LOOP_WAKEUPS, /* main loop returns from a blocking poll */
+	STATS_LOOP_STALLS, /* main loop iterations taking too long */
+	STATS_TIMER_FIRES, /* the tray's own timers, see timer.c */
+	STATS_COUNTER_NUM
+};
+
+typedef enum _stats_counter_e stats_counter_t;
+
+void stats_add(stats_counter_t counter, guint64 n);
+#define stats_inc(__c) stats_add((__c), 1)
+guint64 stats_get(stats_counter_t counter);
+const gchar *stats_counter_name(stats_counter_t counter);
+void stats_record_call_latency(gint64 usec);
+GVariant *stats_get_call_latency(void);
+GVariant *stats_get_call_latency_bounds(void);
+GVariant *stats_to_variant(void);
+void stats_monitor_main_loop(void);
+
+#endif
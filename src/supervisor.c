@@ -0,0 +1,164 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gtk/gtk.h>
+
+#include "proxy.h"
+#include "winctrl.h"
+#include "client.h"
+#include "supervisor.h"
+#include "timer.h"
+
+/* Keeps the tray running across the client restarts: when the client exits
+ * the tray waits for its MPRIS name to appear again (optionally launching
+ * the client itself), finds the new window and rebinds the proxy and the
+ * shared win_client_t in place. */
+
+#define SUPERVISOR_BACKOFF_MIN 1 /* sec */
+#define SUPERVISOR_BACKOFF_MAX 64 /* sec */
+#define SUPERVISOR_BACKOFF_RESET 60 /* client uptime (sec) */
+
+struct _supervisor_s {
+	proxy_t *proxy;
+	win_client_t *client;
+	gchar **client_app_argv;
+	guint timeout; /* window search timeout */
+	gboolean relaunch;
+	GPid spawned_pid;
+	client_name_watch_t *name_watch;
+	client_search_t *search;
+	guint relaunch_id;
+	guint backoff; /* sec */
+	gint64 attach_time; /* monotonic */
+};
+
+static void schedule_relaunch(supervisor_t *supervisor);
+
+static void attach(supervisor_t *supervisor, win_client_t *found)
+{
+	gboolean is_child = supervisor->spawned_pid &&
+		(supervisor->spawned_pid == found->pid);
+
+	g_message("Attaching to the client process %d", found->pid);
+	if (supervisor->spawned_pid && !is_child)
+		client_reap(supervisor->spawned_pid);
+	supervisor->spawned_pid = 0;
+	supervisor->client->window = found->window;
+	supervisor->client->pid = found->pid;
+	winctrl_track_client(supervisor->client);
+	supervisor->attach_time = g_get_monotonic_time();
+	proxy_rebind(supervisor->proxy, found->pid, is_child);
+}
+
+static void on_client_found(win_client_t *found, gpointer user_data)
+{
+	supervisor_t *supervisor = user_data;
+
+	supervisor->search = NULL;
+	if (found->window) {
+		attach(supervisor, found);
+	} else {
+		g_warning("Could not find the Spotify client window");
+		if (supervisor->relaunch)
+			schedule_relaunch(supervisor);
+	}
+}
+
+static void start_search(supervisor_t *supervisor)
+{
+	if (supervisor->search || supervisor->client->window)
+		return;
+	supervisor->search = client_search_new(supervisor->proxy->player_name,
+			supervisor->timeout, on_client_found, supervisor);
+}
+
+static gboolean on_relaunch(gpointer user_data)
+{
+	supervisor_t *supervisor = user_data;
+
+	supervisor->relaunch_id = 0;
+	/* The client might have been started by someone else meanwhile */
+	if (supervisor->client->window || supervisor->search)
+		return G_SOURCE_REMOVE;
+	g_message("Launching the client application");
+	start_search(supervisor);
+	if (!client_launch(supervisor->client_app_argv,
+				&supervisor->spawned_pid)) {
+		client_search_cancel(supervisor->search);
+		supervisor->search = NULL;
+		schedule_relaunch(supervisor);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void schedule_relaunch(supervisor_t *supervisor)
+{
+	if (supervisor->relaunch_id)
+		return;
+	g_message("Relaunching the client in %u s", supervisor->backoff);
+	supervisor->relaunch_id = timer_add_seconds(supervisor->backoff,
+			on_relaunch, supervisor);
+	supervisor->backoff = MIN(supervisor->backoff * 2, SUPERVISOR_BACKOFF_MAX);
+}
+
+static void on_client_exit(proxy_t *proxy, gpointer user_data)
+{
+	supervisor_t *supervisor = user_data;
+	GdkWindow *window = supervisor->client->window;
+
+	g_message("The client has exited");
+	supervisor->client->window = NULL;
+	supervisor->client->pid = 0;
+	if (window)
+		g_object_unref(window);
+	/* The client ran long enough, it's not a crash loop */
+	if (g_get_monotonic_time() - supervisor->attach_time >
+			SUPERVISOR_BACKOFF_RESET * G_USEC_PER_SEC)
+		supervisor->backoff = SUPERVISOR_BACKOFF_MIN;
+	if (supervisor->relaunch)
+		schedule_relaunch(supervisor);
+}
+
+/* The client (re)started by anyone: attach to it */
+static void on_client_name_appeared(gpointer user_data)
+{
+	supervisor_t *supervisor = user_data;
+
+	if (!supervisor->client->window)
+		start_search(supervisor);
+}
+
+supervisor_t *supervisor_new(proxy_t *proxy, win_client_t *client,
+		gchar **client_app_argv, guint timeout, gboolean relaunch)
+{
+	supervisor_t *supervisor = g_malloc0(sizeof(supervisor_t));
+
+	supervisor->proxy = proxy;
+	supervisor->client = client;
+	supervisor->client_app_argv = g_strdupv(client_app_argv);
+	supervisor->timeout = timeout;
+	supervisor->relaunch = relaunch;
+	supervisor->backoff = SUPERVISOR_BACKOFF_MIN;
+	supervisor->attach_time = g_get_monotonic_time();
+	proxy_set_exit_func(proxy, on_client_exit, supervisor);
+	/* Only the appearance matters: the proxy detects the exit */
+	supervisor->name_watch = client_watch_player_name(proxy->player_name,
+			on_client_name_appeared, supervisor);
+
+	return supervisor;
+}
+
+void supervisor_free(supervisor_t *supervisor)
+{
+	if (!supervisor)
+		return;
+	proxy_set_exit_func(supervisor->proxy, NULL, NULL);
+	client_unwatch_player_name(supervisor->name_watch);
+	client_search_cancel(supervisor->search);
+	if (supervisor->relaunch_id)
+		g_source_remove(supervisor->relaunch_id);
+	g_strfreev(supervisor->client_app_argv);
+	g_free(supervisor);
+}
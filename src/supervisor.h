@@ -0,0 +1,10 @@
+#ifndef _SUPERVISOR_H
+#define _SUPERVISOR_H
+
+typedef struct _supervisor_s supervisor_t;
+
+supervisor_t *supervisor_new(proxy_t *proxy, win_client_t *client,
+		gchar **client_app_argv, guint timeout, gboolean relaunch);
+void supervisor_free(supervisor_t *supervisor);
+
+#endif
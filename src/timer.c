@@ -0,0 +1,54 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <glib.h>
+#include "timer.h"
+#include "stats.h"
+
+/* Timer policy: the tray is driven by the X and D-Bus events and must not
+ * wake up at all while nothing happens, so nothing is ever polled.
+ * Deferred or periodic work goes through timer_add_seconds(): GLib aligns
+ * the second-granularity sources session-wide, so they share the wakeups
+ * with the other processes. Only the feedback to user input, which has to
+ * follow the user closely, may use timer_add_input(). Every firing is
+ * counted in the TimerFires statistic. */
+
+struct _timer_source_s {
+	GSourceFunc func;
+	gpointer user_data;
+};
+
+typedef struct _timer_source_s timer_source_t;
+
+static gboolean on_timer(gpointer user_data)
+{
+	timer_source_t *timer = user_data;
+
+	stats_inc(STATS_TIMER_FIRES);
+	return timer->func(timer->user_data);
+}
+
+static timer_source_t *new_timer(GSourceFunc func, gpointer user_data)
+{
+	timer_source_t *timer = g_malloc(sizeof(timer_source_t));
+
+	timer->func = func;
+	timer->user_data = user_data;
+
+	return timer;
+}
+
+/* Like g_timeout_add_seconds(), the returned ID is for g_source_remove() */
+guint timer_add_seconds(guint seconds, GSourceFunc func, gpointer user_data)
+{
+	return g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, seconds, on_timer,
+			new_timer(func, user_data), g_free);
+}
+
+/* A precise timer, only for reacting to user input */
+guint timer_add_input(guint msec, GSourceFunc func, gpointer user_data)
+{
+	return g_timeout_add_full(G_PRIORITY_DEFAULT, msec, on_timer,
+			new_timer(func, user_data), g_free);
+}
@@ -0,0 +1,7 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+guint timer_add_seconds(guint seconds, GSourceFunc func, gpointer user_data);
+guint timer_add_input(guint msec, GSourceFunc func, gpointer user_data);
+
+#endif
@@ -0,0 +1,233 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include "proxy.h"
+#include "tooltip.h"
+
+/* The tooltip format is a Pango markup string with these placeholders:
+ * %t title, %a artists, %r album artists, %A album, %n track number,
+ * %l track length, %p playback position, %m remaining time and %% for the
+ * percent sign. The format is parsed once; all the placeholders but the
+ * playback times are then rendered once per track. */
+
+enum _tooltip_field_e {
+	TOOLTIP_FIELD_LITERAL,
+	TOOLTIP_FIELD_TITLE,
+	TOOLTIP_FIELD_ARTIST,
+	TOOLTIP_FIELD_ALBUM_ARTIST,
+	TOOLTIP_FIELD_ALBUM,
+	TOOLTIP_FIELD_TRACK_NUMBER,
+	TOOLTIP_FIELD_LENGTH,
+	TOOLTIP_FIELD_POSITION,
+	TOOLTIP_FIELD_REMAINING
+};
+
+typedef enum _tooltip_field_e tooltip_field_t;
+
+struct _tooltip_token_s {
+	tooltip_field_t field;
+	gchar *literal; /* only for TOOLTIP_FIELD_LITERAL */
+};
+
+typedef struct _tooltip_token_s tooltip_token_t;
+
+struct _tooltip_format_s {
+	GArray *tokens;
+};
+
+static tooltip_field_t field_for_char(gchar c)
+{
+	switch (c) {
+	case 't':
+		return TOOLTIP_FIELD_TITLE;
+	case 'a':
+		return TOOLTIP_FIELD_ARTIST;
+	case 'r':
+		return TOOLTIP_FIELD_ALBUM_ARTIST;
+	case 'A':
+		return TOOLTIP_FIELD_ALBUM;
+	case 'n':
+		return TOOLTIP_FIELD_TRACK_NUMBER;
+	case 'l':
+		return TOOLTIP_FIELD_LENGTH;
+	case 'p':
+		return TOOLTIP_FIELD_POSITION;
+	case 'm':
+		return TOOLTIP_FIELD_REMAINING;
+	default:
+		return TOOLTIP_FIELD_LITERAL;
+	}
+}
+
+static void add_literal(GArray *tokens, GString *literal)
+{
+	tooltip_token_t token;
+
+	if (literal->len == 0)
+		return;
+	token.field = TOOLTIP_FIELD_LITERAL;
+	token.literal = g_strdup(literal->str);
+	g_array_append_val(tokens, token);
+	g_string_truncate(literal, 0);
+}
+
+/* Parse the format; unknown placeholders are kept as they are. */
+tooltip_format_t *tooltip_format_new(const gchar *format)
+{
+	tooltip_format_t *ret = g_malloc(sizeof(tooltip_format_t));
+	GString *literal = g_string_new(NULL);
+	tooltip_token_t token;
+	const gchar *c;
+
+	ret->tokens = g_array_new(FALSE, FALSE, sizeof(tooltip_token_t));
+	for (c = format; *c != '\0'; c++) {
+		if ((*c != '%') || (c[1] == '\0')) {
+			g_string_append_c(literal, *c);
+			continue;
+		}
+		c++;
+		token.field = field_for_char(*c);
+		if (token.field == TOOLTIP_FIELD_LITERAL) {
+			if (*c != '%')
+				g_string_append_c(literal, '%');
+			g_string_append_c(literal, *c);
+			continue;
+		}
+		add_literal(ret->tokens, literal);
+		token.literal = NULL;
+		g_array_append_val(ret->tokens, token);
+	}
+	add_literal(ret->tokens, literal);
+	g_string_free(literal, TRUE);
+
+	return ret;
+}
+
+void tooltip_format_free(tooltip_format_t *format)
+{
+	guint i;
+
+	if (!format)
+		return;
+	for (i = 0; i < format->tokens->len; i++)
+		g_free(g_array_index(format->tokens, tooltip_token_t, i).literal);
+	g_array_free(format->tokens, TRUE);
+	g_free(format);
+}
+
+/* Format the time in microseconds as [h:]mm:ss */
+gchar *tooltip_format_time(gint64 usec)
+{
+	gint64 sec;
+
+	if (usec < 0)
+		return g_strdup("");
+	sec = usec / G_USEC_PER_SEC;
+	if (sec >= 3600)
+		return g_strdup_printf("%d:%02d:%02d", (gint) (sec / 3600),
+				(gint) (sec / 60 % 60), (gint) (sec % 60));
+	return g_strdup_printf("%d:%02d", (gint) (sec / 60), (gint) (sec % 60));
+}
+
+static void append_escaped(GString *markup, const gchar *text)
+{
+	gchar *escaped;
+
+	if (!text)
+		return;
+	escaped = g_markup_escape_text(text, -1);
+	g_string_append(markup, escaped);
+	g_free(escaped);
+}
+
+static void append_list(GString *markup, gchar **list, guint list_len)
+{
+	guint i;
+
+	for (i = 0; i < list_len; i++) {
+		if (i > 0)
+			g_string_append(markup, ", ");
+		append_escaped(markup, list[i]);
+	}
+}
+
+/* Render the format for the track. The result is a NULL-terminated list of
+ * markup parts alternating with the playback time placeholders ("p" or
+ * "m") between them, see tooltip_format_join(); it has just one item unless
+ * the format shows a playback time. Returns NULL if there's no track. */
+gchar **tooltip_format_render(tooltip_format_t *format,
+		proxy_metadata_t *metadata)
+{
+	GPtrArray *parts;
+	GString *markup;
+	tooltip_token_t *token;
+	gchar *length;
+	guint i;
+
+	if (!metadata || !metadata->track_id)
+		return NULL;
+	parts = g_ptr_array_new();
+	markup = g_string_new(NULL);
+	for (i = 0; i < format->tokens->len; i++) {
+		token = &g_array_index(format->tokens, tooltip_token_t, i);
+		switch (token->field) {
+		case TOOLTIP_FIELD_LITERAL:
+			g_string_append(markup, token->literal);
+			break;
+		case TOOLTIP_FIELD_TITLE:
+			append_escaped(markup, metadata->title);
+			break;
+		case TOOLTIP_FIELD_ARTIST:
+			append_list(markup, metadata->artist, metadata->artist_num);
+			break;
+		case TOOLTIP_FIELD_ALBUM_ARTIST:
+			append_list(markup, metadata->album_artist,
+					metadata->album_artist_num);
+			break;
+		case TOOLTIP_FIELD_ALBUM:
+			append_escaped(markup, metadata->album);
+			break;
+		case TOOLTIP_FIELD_TRACK_NUMBER:
+			if (metadata->track_number > 0)
+				g_string_append_printf(markup, "%d", metadata->track_number);
+			break;
+		case TOOLTIP_FIELD_LENGTH:
+			length = tooltip_format_time(metadata->length);
+			g_string_append(markup, length);
+			g_free(length);
+			break;
+		case TOOLTIP_FIELD_POSITION:
+		case TOOLTIP_FIELD_REMAINING:
+			g_ptr_array_add(parts, g_string_free(markup, FALSE));
+			g_ptr_array_add(parts, g_strdup(
+						token->field == TOOLTIP_FIELD_POSITION ? "p" : "m"));
+			markup = g_string_new(NULL);
+			break;
+		}
+	}
+	g_ptr_array_add(parts, g_string_free(markup, FALSE));
+	g_ptr_array_add(parts, NULL);
+
+	return (gchar **) g_ptr_array_free(parts, FALSE);
+}
+
+/* Fill the playback times (in microseconds, negative if unknown) into the
+ * rendered markup */
+gchar *tooltip_format_join(gchar **markup, gint64 position, gint64 remaining)
+{
+	GString *text = g_string_new(markup[0]);
+	gchar *time;
+	guint i;
+
+	for (i = 1; markup[i] && markup[i + 1]; i += 2) {
+		time = tooltip_format_time(markup[i][0] == 'p' ?
+				position : remaining);
+		g_string_append(text, time);
+		g_string_append(text, markup[i + 1]);
+		g_free(time);
+	}
+
+	return g_string_free(text, FALSE);
+}
@@ -0,0 +1,15 @@
+#ifndef _TOOLTIP_H
+#define _TOOLTIP_H
+
+#define TOOLTIP_DEFAULT_FORMAT "<b>%t</b>\n%r - %A"
+
+typedef struct _tooltip_format_s tooltip_format_t;
+
+tooltip_format_t *tooltip_format_new(const gchar *format);
+void tooltip_format_free(tooltip_format_t *format);
+gchar **tooltip_format_render(tooltip_format_t *format,
+		proxy_metadata_t *metadata);
+gchar *tooltip_format_time(gint64 usec);
+gchar *tooltip_format_join(gchar **markup, gint64 position, gint64 remaining);
+
+#endif
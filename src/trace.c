@@ -0,0 +1,167 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include "stats.h"
+#include "trace.h"
+
+/* Startup phase tracing: every phase becomes a complete event of the
+ * Chrome trace-event format (loadable in Perfetto) with the X requests,
+ * the X round trips of the window scans and the D-Bus method calls made
+ * during the phase. Phases may nest.
+ * x_requests is what Xlib counts (XNextRequest). It learns of the
+ * requests winctrl.c sends through XCB on the same connection only when
+ * it sends its next request, so those are counted at their call sites and
+ * reported apart as xcb_requests; x_requests of a later phase may include
+ * them again. */
+
+struct _trace_event_s {
+	const gchar *name;
+	gint64 start; /* monotonic usec */
+	gint64 duration;
+	guint64 x_requests;
+	guint64 xcb_requests;
+	guint64 x_round_trips;
+	guint dbus_calls;
+};
+
+typedef struct _trace_event_s trace_event_t;
+
+static gchar *trace_file_name = NULL;
+static GArray *events = NULL; /* trace_event_t */
+static GArray *open_events = NULL; /* indices into events */
+static GDBusConnection *bus = NULL;
+static guint filter_id = 0;
+static gint dbus_calls = 0; /* updated from the GDBus worker thread */
+
+/* Number of requests sent to the X server so far */
+static guint64 get_x_requests(void)
+{
+	GdkDisplay *display = gdk_display_get_default();
+
+	if (!display || !GDK_IS_X11_DISPLAY(display))
+		return 0;
+	return XNextRequest(GDK_DISPLAY_XDISPLAY(display));
+}
+
+static GDBusMessage *count_dbus_calls(GDBusConnection *connection,
+		GDBusMessage *message, gboolean incoming, gpointer user_data)
+{
+	if (!incoming && g_dbus_message_get_message_type(message) ==
+			G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+		g_atomic_int_inc(&dbus_calls);
+
+	return message;
+}
+
+/* Start tracing into the given file; start is the monotonic time of the
+ * program start, recorded as the option parsing phase. */
+void trace_start(const gchar *file_name, gint64 start)
+{
+	trace_event_t event = { "parse options", start, 0, 0, 0, 0, 0 };
+
+	trace_file_name = g_strdup(file_name);
+	events = g_array_new(FALSE, FALSE, sizeof(trace_event_t));
+	open_events = g_array_new(FALSE, FALSE, sizeof(guint));
+	event.duration = g_get_monotonic_time() - start;
+	g_array_append_val(events, event);
+	/* Connecting the session bus early is harmless: it's needed right
+	 * away by the single instance check anyway. The Hello call of the
+	 * connect goes out before the filter is there. */
+	trace_begin("bus connect");
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (bus)
+		filter_id = g_dbus_connection_add_filter(bus, count_dbus_calls,
+				NULL, NULL);
+	trace_end();
+}
+
+void trace_begin(const gchar *name)
+{
+	trace_event_t event;
+	guint index;
+
+	if (!events)
+		return;
+	event.name = name;
+	event.start = g_get_monotonic_time();
+	event.duration = 0;
+	event.x_requests = get_x_requests();
+	event.xcb_requests = stats_get(STATS_XCB_REQUESTS);
+	event.x_round_trips = stats_get(STATS_X_ROUND_TRIPS);
+	event.dbus_calls = (guint) g_atomic_int_get(&dbus_calls);
+	index = events->len;
+	g_array_append_val(events, event);
+	g_array_append_val(open_events, index);
+}
+
+/* Ends the innermost open phase */
+void trace_end(void)
+{
+	trace_event_t *event;
+
+	if (!events || open_events->len == 0)
+		return;
+	event = &g_array_index(events, trace_event_t,
+			g_array_index(open_events, guint, open_events->len - 1));
+	g_array_set_size(open_events, open_events->len - 1);
+	event->duration = g_get_monotonic_time() - event->start;
+	event->x_requests = get_x_requests() - event->x_requests;
+	event->xcb_requests = stats_get(STATS_XCB_REQUESTS) -
+		event->xcb_requests;
+	event->x_round_trips = stats_get(STATS_X_ROUND_TRIPS) -
+		event->x_round_trips;
+	event->dbus_calls = (guint) g_atomic_int_get(&dbus_calls) -
+		event->dbus_calls;
+}
+
+/* Closes the open phases, writes the trace file and stops tracing */
+void trace_finish(void)
+{
+	GString *json;
+	trace_event_t *event;
+	GError *error = NULL;
+	guint i;
+	gint pid = (gint) getpid();
+
+	if (!events)
+		return;
+	while (open_events->len > 0)
+		trace_end();
+	json = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (i = 0; i < events->len; i++) {
+		event = &g_array_index(events, trace_event_t, i);
+		g_string_append_printf(json, "%s\n{\"name\":\"%s\",\"cat\":\"startup\","
+				"\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ","
+				"\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d,"
+				"\"args\":{\"x_requests\":%" G_GUINT64_FORMAT ","
+				"\"xcb_requests\":%" G_GUINT64_FORMAT ","
+				"\"x_round_trips\":%" G_GUINT64_FORMAT ","
+				"\"dbus_calls\":%u}}",
+				i ? "," : "", event->name, event->start, event->duration,
+				pid, pid, event->x_requests, event->xcb_requests,
+				event->x_round_trips,
+				event->dbus_calls);
+	}
+	g_string_append(json, "\n]}\n");
+	if (!g_file_set_contents(trace_file_name, json->str, (gssize) json->len,
+				&error)) {
+		g_warning("Could not write the startup trace: %s", error->message);
+		g_error_free(error);
+	}
+	g_string_free(json, TRUE);
+
+	if (bus) {
+		g_dbus_connection_remove_filter(bus, filter_id);
+		g_object_unref(bus);
+		bus = NULL;
+	}
+	g_array_free(open_events, TRUE);
+	g_array_free(events, TRUE);
+	events = NULL;
+	g_free(trace_file_name);
+	trace_file_name = NULL;
+}
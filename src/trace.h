@@ -0,0 +1,9 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+void trace_start(const gchar *file_name, gint64 start);
+void trace_begin(const gchar *name);
+void trace_end(void);
+void trace_finish(void);
+
+#endif
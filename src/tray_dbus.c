@@ -4,14 +4,21 @@
 
 #include <gdk/gdk.h>
 #include <gio/gio.h>
+#include "proxy.h"
+#include "winctrl.h"
+#include "tray_dbus_iface.h"
 #include "tray_dbus.h"
+#include "stats.h"
 
-#define TRAY_SERVICE_NAME "name.smetana.SpotifyTray"
-#define TRAY_OBJECT_PATH "/name/smetana/SpotifyTray"
-#define TRAY_INTERFACE "name.smetana.SpotifyTray"
-#define TRAY_RAISE_WIN_METHOD "RaiseWindow"
-#define TRAY_HIDE_WIN_METHOD "HideWindow"
-#define TRAY_TOGGLE_WIN_METHOD "ToggleWindow"
+#define TRAY_CHECK_TIMEOUT 500 /* msec */
+#define DBUS_SERVICE_NAME "org.freedesktop.DBus"
+#define DBUS_OBJECT_PATH "/org/freedesktop/DBus"
+#define DBUS_INTERFACE "org.freedesktop.DBus"
+#define TRAY_STATS_PROPERTY(__name, __type) \
+	"    <property name='" __name "' type='" __type "' access='read'>" \
+	"      <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal'" \
+	"          value='false'/>" \
+	"    </property>"
 
 static GDBusNodeInfo *introspection_data = NULL;
 static const gchar introspection_xml[] =
@@ -23,33 +30,282 @@ static const gchar introspection_xml[] =
 	"    </method>"
 	"    <method name='" TRAY_TOGGLE_WIN_METHOD "'>"
 	"    </method>"
+	"    <method name='" TRAY_GET_STATS_METHOD "'>"
+	"      <arg type='a{sv}' name='stats' direction='out'/>"
+	"    </method>"
+	"    <method name='" TRAY_PLAY_PAUSE_METHOD "'/>"
+	"    <method name='" TRAY_PLAY_METHOD "'/>"
+	"    <method name='" TRAY_PAUSE_METHOD "'/>"
+	"    <method name='" TRAY_STOP_METHOD "'/>"
+	"    <method name='" TRAY_NEXT_METHOD "'/>"
+	"    <method name='" TRAY_PREVIOUS_METHOD "'/>"
+	"    <method name='" TRAY_SEEK_METHOD "'>"
+	"      <arg type='x' name='offset' direction='in'/>"
+	"    </method>"
+	"    <method name='" TRAY_SET_VOLUME_METHOD "'>"
+	"      <arg type='d' name='volume' direction='in'/>"
+	"    </method>"
+	"    <method name='" TRAY_EXECUTE_BATCH_METHOD "'>"
+	"      <arg type='a(sv)' name='commands' direction='in'/>"
+	"    </method>"
+	TRAY_STATS_PROPERTY("SignalsReceived", "t")
+	TRAY_STATS_PROPERTY("MetadataParses", "t")
+	TRAY_STATS_PROPERTY("CallsSent", "t")
+	TRAY_STATS_PROPERTY("CallFailures", "t")
+	TRAY_STATS_PROPERTY("XRoundTrips", "t")
+	TRAY_STATS_PROPERTY("XcbRequests", "t")
+	TRAY_STATS_PROPERTY("LoopWakeups", "t")
+	TRAY_STATS_PROPERTY("LoopStalls", "t")
+	TRAY_STATS_PROPERTY("TimerFires", "t")
+	TRAY_STATS_PROPERTY("CallLatency", "at")
+	TRAY_STATS_PROPERTY("CallLatencyBounds", "at")
 	"  </interface>"
 	"</node>";
 
 
+struct _tray_dbus_s {
+	win_client_t *client;
+	proxy_t *proxy;
+};
+
+typedef struct _tray_dbus_s tray_dbus_t;
+
+/* Commands available both as methods and in a batch */
+enum _tray_command_e {
+	TRAY_COMMAND_RAISE,
+	TRAY_COMMAND_HIDE,
+	TRAY_COMMAND_TOGGLE,
+	TRAY_COMMAND_PLAY_PAUSE,
+	TRAY_COMMAND_PLAY,
+	TRAY_COMMAND_PAUSE,
+	TRAY_COMMAND_STOP,
+	TRAY_COMMAND_NEXT,
+	TRAY_COMMAND_PREVIOUS,
+	TRAY_COMMAND_SEEK,
+	TRAY_COMMAND_SET_VOLUME,
+	TRAY_COMMAND_NUM
+};
+
+typedef enum _tray_command_e tray_command_t;
+
+struct _tray_command_info_s {
+	const gchar *name;
+	const gchar *arg_type; /* TRAY_BATCH_NO_ARG_TYPE if there's none */
+	gboolean needs_window;
+};
+
+typedef struct _tray_command_info_s tray_command_info_t;
+
+static const tray_command_info_t tray_commands[] = {
+	[TRAY_COMMAND_RAISE] = { TRAY_RAISE_WIN_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, TRUE },
+	[TRAY_COMMAND_HIDE] = { TRAY_HIDE_WIN_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, TRUE },
+	[TRAY_COMMAND_TOGGLE] = { TRAY_TOGGLE_WIN_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, TRUE },
+	[TRAY_COMMAND_PLAY_PAUSE] = { TRAY_PLAY_PAUSE_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, FALSE },
+	[TRAY_COMMAND_PLAY] = { TRAY_PLAY_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, FALSE },
+	[TRAY_COMMAND_PAUSE] = { TRAY_PAUSE_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, FALSE },
+	[TRAY_COMMAND_STOP] = { TRAY_STOP_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, FALSE },
+	[TRAY_COMMAND_NEXT] = { TRAY_NEXT_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, FALSE },
+	[TRAY_COMMAND_PREVIOUS] = { TRAY_PREVIOUS_METHOD,
+		TRAY_BATCH_NO_ARG_TYPE, FALSE },
+	[TRAY_COMMAND_SEEK] = { TRAY_SEEK_METHOD, "x", FALSE },
+	[TRAY_COMMAND_SET_VOLUME] = { TRAY_SET_VOLUME_METHOD, "d", FALSE }
+};
+
+static gint find_command(const gchar *name)
+{
+	gint i;
+
+	for (i = 0; i < TRAY_COMMAND_NUM; i++)
+		if (g_strcmp0(tray_commands[i].name, name) == 0)
+			return i;
+
+	return -1;
+}
+
+/* Checks the command can be run; the argument type is checked by GDBus
+ * for the methods but not for the batch items. */
+static gboolean check_command(tray_dbus_t *tray, gint command, GVariant *arg,
+		GError **error)
+{
+	if (command < 0) {
+		g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+				"Unknown command");
+		return FALSE;
+	}
+	if (!g_variant_is_of_type(arg,
+				G_VARIANT_TYPE(tray_commands[command].arg_type))) {
+		g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+				"%s takes an argument of type %s",
+				tray_commands[command].name, tray_commands[command].arg_type);
+		return FALSE;
+	}
+	if (tray_commands[command].needs_window && !tray->client->window) {
+		g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+				"The client is not running");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Runs a checked command; the player commands are just queued on the
+ * proxy connection. */
+static void run_command(tray_dbus_t *tray, tray_command_t command,
+		GVariant *arg)
+{
+	switch (command) {
+	case TRAY_COMMAND_RAISE:
+		winctrl_raise(tray->client);
+		break;
+	case TRAY_COMMAND_HIDE:
+		winctrl_hide(tray->client);
+		break;
+	case TRAY_COMMAND_TOGGLE:
+		winctrl_toggle(tray->client);
+		break;
+	case TRAY_COMMAND_PLAY_PAUSE:
+		proxy_simple_method_call(tray->proxy, PROXY_CALL_PLAYPAUSE);
+		break;
+	case TRAY_COMMAND_PLAY:
+		proxy_simple_method_call(tray->proxy, PROXY_CALL_PLAY);
+		break;
+	case TRAY_COMMAND_PAUSE:
+		proxy_simple_method_call(tray->proxy, PROXY_CALL_PAUSE);
+		break;
+	case TRAY_COMMAND_STOP:
+		proxy_simple_method_call(tray->proxy, PROXY_CALL_STOP);
+		break;
+	case TRAY_COMMAND_NEXT:
+		proxy_simple_method_call(tray->proxy, PROXY_CALL_NEXT);
+		break;
+	case TRAY_COMMAND_PREVIOUS:
+		proxy_simple_method_call(tray->proxy, PROXY_CALL_PREV);
+		break;
+	case TRAY_COMMAND_SEEK:
+		proxy_seek(tray->proxy, g_variant_get_int64(arg));
+		break;
+	case TRAY_COMMAND_SET_VOLUME:
+		proxy_set_volume(tray->proxy, g_variant_get_double(arg));
+		break;
+	default:
+		break;
+	}
+}
+
+/* ExecuteBatch: all the commands are checked first so a bad batch has no
+ * effect at all. That includes the room in the proxy call queue: every
+ * player command queues one call and a full queue would drop the rest of
+ * the batch. */
+static void execute_batch(tray_dbus_t *tray, GVariant *parameters,
+		GDBusMethodInvocation *invocation)
+{
+	GVariant *commands = g_variant_get_child_value(parameters, 0);
+	gsize n = g_variant_n_children(commands);
+	gint *command = g_new(gint, n);
+	GVariant **arg = g_new0(GVariant *, n);
+	const gchar *name;
+	GError *error = NULL;
+	gsize i, calls = 0;
+
+	if (n > TRAY_BATCH_MAX) {
+		g_set_error(&error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+				"At most %d commands are allowed in a batch", TRAY_BATCH_MAX);
+		goto out;
+	}
+	for (i = 0; i < n; i++) {
+		g_variant_get_child(commands, i, "(&sv)", &name, &arg[i]);
+		command[i] = find_command(name);
+		if (!check_command(tray, command[i], arg[i], &error)) {
+			g_prefix_error(&error, "Command %" G_GSIZE_FORMAT " (%s): ",
+					i, name);
+			goto out;
+		}
+		if (!tray_commands[command[i]].needs_window)
+			calls++;
+	}
+	if (calls > proxy_get_free_call_slots(tray->proxy)) {
+		g_set_error(&error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+				"Too many player calls pending, the batch needs %"
+				G_GSIZE_FORMAT " slots, %u are free", calls,
+				proxy_get_free_call_slots(tray->proxy));
+		goto out;
+	}
+	for (i = 0; i < n; i++)
+		run_command(tray, command[i], arg[i]);
+out:
+	if (error)
+		g_dbus_method_invocation_take_error(invocation, error);
+	else
+		g_dbus_method_invocation_return_value(invocation, NULL);
+	for (i = 0; i < n; i++)
+		if (arg[i])
+			g_variant_unref(arg[i]);
+	g_free(arg);
+	g_free(command);
+	g_variant_unref(commands);
+}
+
 static void handle_method_call(GDBusConnection *connection, const gchar *sender,
 		const gchar *object_path, const gchar *interface_name,
 		const gchar *method_name, GVariant *parameters,
 		GDBusMethodInvocation *invocation, gpointer user_data)
 {
-	GdkWindow *client_window = GDK_WINDOW(user_data);
+	tray_dbus_t *tray = user_data;
+	gint command;
+	GVariant *arg;
+	GError *error = NULL;
 
-	if (g_strcmp0(method_name, TRAY_RAISE_WIN_METHOD) == 0) {
-		if (!gdk_window_is_visible(client_window)) {
-			gdk_window_show(client_window);
-		}
-	} else if (g_strcmp0(method_name, TRAY_HIDE_WIN_METHOD) == 0) {
-		if (gdk_window_is_visible(client_window)) {
-			gdk_window_hide(client_window);
-		}
-	} else if (g_strcmp0(method_name, TRAY_TOGGLE_WIN_METHOD) == 0) {
-		if (gdk_window_is_visible(client_window)) {
-			gdk_window_hide(client_window);
-		} else {
-			gdk_window_show(client_window);
-		}
+	if (g_strcmp0(method_name, TRAY_GET_STATS_METHOD) == 0) {
+		g_dbus_method_invocation_return_value(invocation,
+				g_variant_new("(@a{sv})", stats_to_variant()));
+		return;
+	}
+	if (g_strcmp0(method_name, TRAY_EXECUTE_BATCH_METHOD) == 0) {
+		execute_batch(tray, parameters, invocation);
+		return;
+	}
+	/* Single argument methods get it unwrapped */
+	if (g_variant_n_children(parameters) == 1)
+		arg = g_variant_get_child_value(parameters, 0);
+	else
+		arg = g_variant_ref(parameters);
+	command = find_command(method_name);
+	if (check_command(tray, command, arg, &error)) {
+		run_command(tray, command, arg);
+		g_dbus_method_invocation_return_value(invocation, NULL);
+	} else {
+		g_dbus_method_invocation_take_error(invocation, error);
 	}
-	g_dbus_method_invocation_return_value(invocation, NULL);
+	g_variant_unref(arg);
+}
+
+/* The statistics properties */
+static GVariant *handle_get_property(GDBusConnection *connection,
+		const gchar *sender, const gchar *object_path,
+		const gchar *interface_name, const gchar *property_name,
+		GError **error, gpointer user_data)
+{
+	guint i;
+
+	if (g_strcmp0(property_name, "CallLatency") == 0)
+		return stats_get_call_latency();
+	if (g_strcmp0(property_name, "CallLatencyBounds") == 0)
+		return stats_get_call_latency_bounds();
+	for (i = 0; i < STATS_COUNTER_NUM; i++)
+		if (g_strcmp0(property_name, stats_counter_name(i)) == 0)
+			return g_variant_new_uint64(stats_get(i));
+	g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+			"Unknown property %s", property_name);
+
+	return NULL;
 }
 
 static void on_bus_acquired(GDBusConnection *connection,
@@ -59,7 +315,7 @@ static void on_bus_acquired(GDBusConnection *connection,
 	static const GDBusInterfaceVTable interface_vtable =
 	{
 		handle_method_call,
-		NULL,
+		handle_get_property,
 		NULL
 	};
 
@@ -80,10 +336,13 @@ static void on_name_lost(GDBusConnection *connection,
 	g_critical("Lost D-Bus bus ownership");
 }
 
-guint tray_dbus_server_new(GdkWindow *win)
+guint tray_dbus_server_new(win_client_t *client, proxy_t *proxy)
 {
+	tray_dbus_t *tray = g_malloc0(sizeof(tray_dbus_t));
 	guint owner_id;
 
+	tray->client = client;
+	tray->proxy = proxy;
 	if (!introspection_data)
 		introspection_data =
 			g_dbus_node_info_new_for_xml(introspection_xml, NULL);
@@ -93,8 +352,8 @@ guint tray_dbus_server_new(GdkWindow *win)
 			on_bus_acquired,
 			NULL, /* on_name_acquired */
 			on_name_lost,
-			(gpointer) win, /* user_data */
-			NULL); /* user data free func */
+			tray, /* user_data */
+			g_free); /* user data free func */
 
 	return owner_id;
 }
@@ -106,38 +365,62 @@ void tray_dbus_server_destroy(guint owner_id)
 	g_dbus_node_info_unref(introspection_data);
 }
 
+/* Checks for a running instance and asks it to raise or toggle the client
+ * window. Neither the check nor the request may hang on a wedged instance:
+ * the bus itself answers whether the name is owned, the request is sent
+ * without waiting for a reply. */
 gboolean tray_dbus_server_check_running(gboolean toggle)
 {
-	GDBusProxy *proxy;
-	gboolean ret = FALSE;
+	GDBusConnection *bus;
+	GDBusMessage *message;
+	GVariant *result;
+	gboolean running = FALSE;
 	GError *error = NULL;
 	const gchar *method = toggle ? TRAY_TOGGLE_WIN_METHOD : TRAY_RAISE_WIN_METHOD;
 
-	proxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SESSION,
-			G_DBUS_PROXY_FLAGS_NONE,
-			NULL, /* GDBusInterfaceInfo */
-			TRAY_SERVICE_NAME,
-			TRAY_OBJECT_PATH,
-			TRAY_INTERFACE,
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	if (!bus) {
+		g_debug("Could not connect to the session bus: %s", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	result = g_dbus_connection_call_sync(bus,
+			DBUS_SERVICE_NAME,
+			DBUS_OBJECT_PATH,
+			DBUS_INTERFACE,
+			"NameHasOwner",
+			g_variant_new("(s)", TRAY_SERVICE_NAME),
+			G_VARIANT_TYPE("(b)"),
+			G_DBUS_CALL_FLAGS_NONE,
+			TRAY_CHECK_TIMEOUT,
 			NULL, /* GCancellable */
 			&error);
-	if (!proxy || error)
+	if (!result) {
+		g_debug("D-Bus method 'NameHasOwner' call failed: %s", error->message);
+		g_error_free(error);
 		goto out;
-	g_dbus_proxy_call_sync(proxy,
-			method,
-			NULL,
-			G_DBUS_CALL_FLAGS_NONE,
-			-1,
-			NULL,
-			&error);
-	if (error) {
+	}
+	g_variant_get(result, "(b)", &running);
+	g_variant_unref(result);
+	if (!running)
+		goto out;
+
+	message = g_dbus_message_new_method_call(TRAY_SERVICE_NAME,
+			TRAY_OBJECT_PATH, TRAY_INTERFACE, method);
+	g_dbus_message_set_flags(message,
+			G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED |
+			G_DBUS_MESSAGE_FLAGS_NO_AUTO_START);
+	if (g_dbus_connection_send_message(bus, message,
+				G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, &error)) {
+		g_dbus_connection_flush_sync(bus, NULL, NULL);
+	} else {
 		g_debug("D-Bus method '%s' call failed: %s", method, error->message);
 		g_error_free(error);
-	} else {
-		ret = TRUE;
 	}
-	g_object_unref(proxy);
+	g_object_unref(message);
 out:
-	return ret;
+	g_object_unref(bus);
+
+	return running;
 }
 
@@ -2,7 +2,7 @@
 #define _DBUS_SERVER_H
 
 gboolean tray_dbus_server_check_running(gboolean toggle);
-guint tray_dbus_server_new(GdkWindow *win);
+guint tray_dbus_server_new(win_client_t *client, proxy_t *proxy);
 void tray_dbus_server_destroy(guint owner_id);
 
 #endif
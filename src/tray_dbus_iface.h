@@ -0,0 +1,26 @@
+#ifndef _TRAY_DBUS_IFACE_H
+#define _TRAY_DBUS_IFACE_H
+
+/* The tray D-Bus interface, shared by the tray and spotify-tray-ctl */
+#define TRAY_SERVICE_NAME "name.smetana.SpotifyTray"
+#define TRAY_OBJECT_PATH "/name/smetana/SpotifyTray"
+#define TRAY_INTERFACE "name.smetana.SpotifyTray"
+#define TRAY_RAISE_WIN_METHOD "RaiseWindow"
+#define TRAY_HIDE_WIN_METHOD "HideWindow"
+#define TRAY_TOGGLE_WIN_METHOD "ToggleWindow"
+#define TRAY_GET_STATS_METHOD "GetStats"
+#define TRAY_PLAY_PAUSE_METHOD "PlayPause"
+#define TRAY_PLAY_METHOD "Play"
+#define TRAY_PAUSE_METHOD "Pause"
+#define TRAY_STOP_METHOD "Stop"
+#define TRAY_NEXT_METHOD "Next"
+#define TRAY_PREVIOUS_METHOD "Previous"
+#define TRAY_SEEK_METHOD "Seek"
+#define TRAY_SET_VOLUME_METHOD "SetVolume"
+#define TRAY_EXECUTE_BATCH_METHOD "ExecuteBatch"
+#define TRAY_BATCH_MAX 32 /* commands per batch */
+/* The batch item argument of the commands without one: an empty string,
+ * D-Bus has no empty tuple */
+#define TRAY_BATCH_NO_ARG_TYPE "s"
+
+#endif
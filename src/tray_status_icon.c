@@ -4,7 +4,46 @@
 
 #include <gtk/gtk.h>
 #include "proxy.h"
+#include "winctrl.h"
 #include "tray_status_icon.h"
+#include "tooltip.h"
+#include "art.h"
+#include "icon_atlas.h"
+#include "timer.h"
+
+#define SCROLL_COALESCE_TIME 150 /* msec */
+#define SCROLL_MAX_LATENCY 400 /* msec, a long spin still gets feedback */
+#define SCROLL_SEEK_STEP 5000000 /* usec */
+#define SCROLL_VOLUME_STEP 0.05
+#define TOOLTIP_ART_SIZE 96 /* px */
+
+struct _tray_icon_s {
+	proxy_t *proxy;
+	win_client_t *client;
+	tray_scroll_mode_t scroll_mode;
+	tooltip_format_t *tooltip_format;
+	art_cache_t *art;
+	GtkStatusIcon *status_icon;
+	icon_atlas_t *icon_atlas;
+	proxy_playback_status_t icon_status; /* shown in the icon */
+	/* Popup menu, built on the first right click */
+	GtkWidget *menu;
+	GtkWidget *track_item;
+	GtkWidget *time_item; /* elapsed / length, set on popup */
+	GtkWidget *play_item;
+	GtkWidget *pause_item;
+	GtkWidget *stop_item;
+	GtkWidget *shuffle_item;
+	GtkWidget *loop_item;
+	/* Scroll burst being coalesced */
+	tray_scroll_mode_t burst_mode;
+	gdouble burst_steps; /* the fraction left over is kept */
+	gint64 burst_start; /* monotonic time, 0 if no burst */
+	guint burst_timeout_id;
+};
+
+typedef struct _tray_icon_s tray_icon_t;
+#define TRAY_ICON_T(__o) ((tray_icon_t *)(__o))
 
 void on_play_activate(GtkWidget *menuitem, gpointer user_data)
 {
@@ -36,85 +75,109 @@ void on_stop_activate(GtkWidget *menuitem, gpointer user_data)
 	proxy_simple_method_call(PROXY_T(user_data), PROXY_CALL_STOP);
 }
 
-void on_random_toggled(GtkWidget *menuitem, gpointer user_data)
+void on_loop_toggled(GtkWidget *menuitem, gpointer user_data)
 {
-	g_debug("random toggled");
+	g_debug("loop toggled");
+	proxy_set_loop(PROXY_T(user_data),
+			gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(menuitem)) ?
+			PROXY_LOOP_PLAYLIST : PROXY_LOOP_NONE);
 }
 
 void on_shuffle_toggled(GtkWidget *menuitem, gpointer user_data)
 {
 	g_debug("shuffle toggled");
+	proxy_set_shuffle(PROXY_T(user_data),
+			gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(menuitem)));
 }
 
 void on_quit_activate(GtkWidget *menuitem, gpointer user_data)
 {
-	GdkWindow *client_window = GDK_WINDOW(user_data);
+	win_client_t *client = user_data;
 
-	gdk_window_destroy(client_window);
+	if (client->window)
+		gdk_window_destroy(client->window);
 	gtk_main_quit();
 }
 
 
+static GtkWidget *new_popup_menu(tray_icon_t *tray);
+
+/* The playback time comes from the local clock, there's no need to keep it
+ * ticking: it's set whenever the menu is shown. */
+static void update_time_item(tray_icon_t *tray)
+{
+	proxy_t *proxy = tray->proxy;
+	gint64 position = proxy_get_position(proxy);
+	gchar *elapsed, *length, *label;
+
+	if (position < 0 || !proxy->metadata->track_id) {
+		gtk_widget_hide(tray->time_item);
+		return;
+	}
+	elapsed = tooltip_format_time(position);
+	if (proxy->metadata->length > 0) {
+		length = tooltip_format_time((gint64) proxy->metadata->length);
+		label = g_strdup_printf("%s / %s", elapsed, length);
+		g_free(length);
+	} else {
+		label = g_strdup(elapsed);
+	}
+	gtk_menu_item_set_label(GTK_MENU_ITEM(tray->time_item), label);
+	gtk_widget_show(tray->time_item);
+	g_free(label);
+	g_free(elapsed);
+}
+
 /* Right click callback: show popup menu. */
 static void on_popup(GtkStatusIcon *icon, guint button,
 		guint activate_time, gpointer user_data)
 {
-	GtkWidget *popup_menu = GTK_WIDGET(user_data);
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
 
-	gtk_widget_show_all(popup_menu);
-	gtk_menu_popup(GTK_MENU(popup_menu), NULL, NULL, NULL, NULL,
+	if (!tray->menu)
+		tray->menu = new_popup_menu(tray);
+	update_time_item(tray);
+	gtk_menu_popup(GTK_MENU(tray->menu), NULL, NULL, NULL, NULL,
 		button, activate_time);
 }
 
 /* Left click callback: toggle the Spotify window visibility. */
 static void on_activate(GtkStatusIcon *icon, gpointer user_data)
 {
-	GdkWindow *client_window = GDK_WINDOW(user_data);
+	winctrl_toggle(user_data);
+}
 
-	if (gdk_window_is_visible(client_window)) {
-		gdk_window_hide(client_window);
-	} else {
-		gdk_window_show(client_window);
-	}
-	/* If the window is minimized, show it back */
-	if (gdk_window_get_state(client_window) &
-			(GDK_WINDOW_STATE_ICONIFIED|GDK_WINDOW_STATE_WITHDRAWN))
-		gdk_window_deiconify(client_window);
-	/* Raise the window too -- this has no effect when hiding */
-	gdk_window_raise(client_window);
-}
-
-/* Contructs the tooltip showing some info about current track.
- * Would be great to show the album art but it's stored in locked database
- * while Spotify client is running. Using the webpage referenced in the
- * metadata is no-go. */
+/* Shows the tooltip with some info about current track. The markup is
+ * rendered and the album art fetched on track change, only the playback
+ * times (if the tooltip format shows them) need to be filled in here; they
+ * come from the local playback clock. Art that failed to load is fetched
+ * again once art.c lets the failure expire. */
 static gboolean on_tooltip_query(GtkStatusIcon *status_icon, gint x, gint y,
 		gboolean keyboard_mode, GtkTooltip *tooltip, gpointer user_data)
 {
-	proxy_t *proxy = PROXY_T(user_data);
-	gchar *tooltip_text, *tooltip_title, *tooltip_artist, *tooltip_album;
-	gchar *artist_str;
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
+	proxy_t *proxy = tray->proxy;
+	gchar **markup;
+	gchar *tooltip_text;
 
-	if (!proxy->metadata || !proxy->metadata->artist) {
+	if (!proxy->metadata || !(markup = proxy->metadata->tooltip_markup)) {
 		return FALSE;
 	}
-	tooltip_title = g_markup_escape_text(proxy->metadata->title, -1);
-	artist_str = g_strjoinv(", ", proxy->metadata->album_artist);
-	tooltip_artist = g_markup_escape_text(artist_str, -1);
-	tooltip_album = g_markup_escape_text(proxy->metadata->album, -1);
-	tooltip_text = g_strdup_printf("<b>%s</b>\n%s - %s",
-			 tooltip_title, tooltip_artist, tooltip_album);
+	art_cache_fetch(tray->art, proxy->metadata->art_url);
+	gtk_tooltip_set_icon(tooltip,
+			art_cache_lookup(tray->art, proxy->metadata->art_url));
+	if (!markup[1]) {
+		gtk_tooltip_set_markup(tooltip, markup[0]);
+		return TRUE;
+	}
+	tooltip_text = tooltip_format_join(markup, proxy_get_position(proxy),
+			proxy_get_remaining(proxy));
 	gtk_tooltip_set_markup(tooltip, tooltip_text);
 	g_free(tooltip_text);
-	g_free(artist_str);
-	g_free(tooltip_title);
-	g_free(tooltip_artist);
-	g_free(tooltip_album);
 
 	return TRUE;
 }
 
-
 /* Mouse middle button click: toggle play / pause */
 static gboolean on_button_release(GtkStatusIcon *status_icon,
 		GdkEvent *event, gpointer user_data)
@@ -127,110 +190,298 @@ static gboolean on_button_release(GtkStatusIcon *status_icon,
 }
 
 
-/* Mouse wheel event: switch to next/previous track */
+/* Turn the whole scroll burst into a single player call; a fraction of
+ * a step (slow smooth scrolling) waits for the next burst. */
+static void flush_scroll_burst(tray_icon_t *tray)
+{
+	gint steps = (gint) tray->burst_steps;
+	gdouble volume;
+
+	if (tray->burst_timeout_id) {
+		g_source_remove(tray->burst_timeout_id);
+		tray->burst_timeout_id = 0;
+	}
+	tray->burst_start = 0;
+	tray->burst_steps -= steps;
+	if (steps == 0)
+		return;
+	switch (tray->burst_mode) {
+	case TRAY_SCROLL_TRACK:
+		proxy_simple_method_call(tray->proxy,
+				steps > 0 ? PROXY_CALL_NEXT : PROXY_CALL_PREV);
+		break;
+	case TRAY_SCROLL_SEEK:
+		proxy_seek(tray->proxy, (gint64) steps * SCROLL_SEEK_STEP);
+		break;
+	case TRAY_SCROLL_VOLUME:
+		if ((volume = proxy_get_volume(tray->proxy)) >= 0.0)
+			proxy_set_volume(tray->proxy, volume + steps * SCROLL_VOLUME_STEP);
+		break;
+	}
+}
+
+static gboolean on_scroll_burst_end(gpointer user_data)
+{
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
+
+	tray->burst_timeout_id = 0;
+	flush_scroll_burst(tray);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Mouse wheel event: switch to next/previous track, seek or change volume.
+ * The events are accumulated until the wheel rests for a while, but no
+ * longer than SCROLL_MAX_LATENCY. */
 static gboolean on_scroll(GtkStatusIcon *status_icon,
 		GdkEvent *event, gpointer user_data)
 {
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
+	tray_scroll_mode_t mode = tray->scroll_mode;
+	gdouble dx, dy;
+	gint64 now = g_get_monotonic_time();
+	gint elapsed;
+
+	if (event->scroll.state & GDK_SHIFT_MASK)
+		mode = TRAY_SCROLL_SEEK;
+	else if (event->scroll.state & GDK_CONTROL_MASK)
+		mode = TRAY_SCROLL_VOLUME;
+	if (mode != tray->burst_mode) {
+		flush_scroll_burst(tray);
+		tray->burst_steps = 0.0;
+		tray->burst_mode = mode;
+	}
+
 	if (event->scroll.direction == GDK_SCROLL_UP) {
-		proxy_simple_method_call(PROXY_T(user_data), PROXY_CALL_NEXT);
+		tray->burst_steps += 1.0;
 	} else if (event->scroll.direction == GDK_SCROLL_DOWN) {
-		proxy_simple_method_call(PROXY_T(user_data), PROXY_CALL_PREV);
+		tray->burst_steps -= 1.0;
+	} else if ((event->scroll.direction == GDK_SCROLL_SMOOTH) &&
+			gdk_event_get_scroll_deltas(event, &dx, &dy)) {
+		tray->burst_steps -= dy;
 	}
 
+	if (!tray->burst_start)
+		tray->burst_start = now;
+	elapsed = (gint) ((now - tray->burst_start) / 1000);
+	if (elapsed >= SCROLL_MAX_LATENCY) {
+		flush_scroll_burst(tray);
+		return TRUE;
+	}
+	if (tray->burst_timeout_id)
+		g_source_remove(tray->burst_timeout_id);
+	tray->burst_timeout_id = timer_add_input(
+			MIN(SCROLL_COALESCE_TIME, SCROLL_MAX_LATENCY - elapsed),
+			on_scroll_burst_end, tray);
+
 	return TRUE;
 }
 
 
-/* Set up the right-click popup menu. */
-static GtkMenu *new_popup_menu(proxy_t *proxy, GdkWindow *client_window)
+static void set_check_item(GtkWidget *item, gboolean active,
+		GCallback handler, gpointer user_data)
+{
+	/* Reflecting the player state must not call back to the player */
+	g_signal_handlers_block_by_func(item, handler, user_data);
+	gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item), active);
+	g_signal_handlers_unblock_by_func(item, handler, user_data);
+}
+
+/* Bring the popup menu in line with the player state */
+static void update_popup_menu(tray_icon_t *tray, guint changes)
+{
+	proxy_t *proxy = tray->proxy;
+	proxy_metadata_t *metadata = proxy->metadata;
+	gboolean playing = (proxy->state.status == PROXY_STATUS_PLAYING);
+	gchar *track;
+
+	if (!tray->menu)
+		return;
+	if (changes & PROXY_CHANGED_METADATA) {
+		if (metadata && metadata->track_id && metadata->title) {
+			if (metadata->artist && metadata->artist[0])
+				track = g_strdup_printf("%s \xe2\x80\x93 %s", metadata->title,
+						metadata->artist[0]);
+			else
+				track = g_strdup(metadata->title);
+			gtk_menu_item_set_label(GTK_MENU_ITEM(tray->track_item), track);
+			g_free(track);
+			gtk_widget_show(tray->track_item);
+		} else {
+			gtk_widget_hide(tray->track_item);
+		}
+	}
+	if (changes & PROXY_CHANGED_STATE) {
+		gtk_widget_set_sensitive(tray->play_item, !playing);
+		gtk_widget_set_sensitive(tray->pause_item, playing);
+		gtk_widget_set_sensitive(tray->stop_item,
+				playing || (proxy->state.status == PROXY_STATUS_PAUSED));
+		set_check_item(tray->shuffle_item, proxy->state.shuffle,
+				G_CALLBACK(on_shuffle_toggled), proxy);
+		set_check_item(tray->loop_item,
+				proxy->state.loop != PROXY_LOOP_NONE,
+				G_CALLBACK(on_loop_toggled), proxy);
+	}
+	/* Seeks and track changes while the menu is open */
+	update_time_item(tray);
+}
+
+static GtkWidget *append_item(GtkWidget *menu, GtkWidget *item,
+		GCallback handler, gpointer user_data)
+{
+	gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+	if (handler)
+		g_signal_connect((gpointer) item,
+				GTK_IS_CHECK_MENU_ITEM(item) ? "toggled" : "activate",
+				handler, user_data);
+
+	return item;
+}
+
+/* Set up the right-click popup menu; it's kept up to date from the player
+ * state afterwards. */
+static GtkWidget *new_popup_menu(tray_icon_t *tray)
 {
 	GtkWidget *popup_menu = gtk_menu_new();
-	GtkWidget *play_menu_item =
-		gtk_image_menu_item_new_from_stock(GTK_STOCK_MEDIA_PLAY, NULL);
-	GtkWidget *pause_menu_item =
-		gtk_image_menu_item_new_from_stock(GTK_STOCK_MEDIA_PAUSE, NULL);
-	GtkWidget *stop_menu_item =
-		gtk_image_menu_item_new_from_stock(GTK_STOCK_MEDIA_STOP, NULL);
-	GtkWidget *next_menu_item =
-		gtk_image_menu_item_new_from_stock(GTK_STOCK_MEDIA_NEXT, NULL);
-	GtkWidget *prev_menu_item =
-		gtk_image_menu_item_new_from_stock(GTK_STOCK_MEDIA_PREVIOUS, NULL);
-	GtkWidget *separator =
-		gtk_separator_menu_item_new();
-	GtkWidget *quit_menu_item =
-		gtk_image_menu_item_new_from_stock(GTK_STOCK_QUIT, NULL);
-	
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), play_menu_item);
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), pause_menu_item);
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), stop_menu_item);
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), next_menu_item);
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), prev_menu_item);
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), separator);
-	gtk_menu_shell_append(GTK_MENU_SHELL(popup_menu), quit_menu_item);
-	
-	g_signal_connect((gpointer) play_menu_item, "activate",
+	proxy_t *proxy = tray->proxy;
+
+	tray->track_item = append_item(popup_menu, gtk_menu_item_new_with_label(""),
+			NULL, NULL);
+	gtk_widget_set_sensitive(tray->track_item, FALSE);
+	gtk_label_set_max_width_chars(GTK_LABEL(gtk_bin_get_child(
+					GTK_BIN(tray->track_item))), 40);
+	gtk_label_set_ellipsize(GTK_LABEL(gtk_bin_get_child(
+					GTK_BIN(tray->track_item))), PANGO_ELLIPSIZE_END);
+	tray->time_item = append_item(popup_menu, gtk_menu_item_new_with_label(""),
+			NULL, NULL);
+	gtk_widget_set_sensitive(tray->time_item, FALSE);
+	tray->play_item = append_item(popup_menu,
+			gtk_menu_item_new_with_mnemonic("_Play"),
 			G_CALLBACK(on_play_activate), proxy);
-	g_signal_connect((gpointer) pause_menu_item, "activate",
+	tray->pause_item = append_item(popup_menu,
+			gtk_menu_item_new_with_mnemonic("P_ause"),
 			G_CALLBACK(on_pause_activate), proxy);
-	g_signal_connect((gpointer) stop_menu_item, "activate",
+	tray->stop_item = append_item(popup_menu,
+			gtk_menu_item_new_with_mnemonic("_Stop"),
 			G_CALLBACK(on_stop_activate), proxy);
-	g_signal_connect((gpointer) next_menu_item, "activate",
+	append_item(popup_menu, gtk_menu_item_new_with_mnemonic("_Next"),
 			G_CALLBACK(on_next_activate), proxy);
-	g_signal_connect((gpointer) prev_menu_item, "activate",
+	append_item(popup_menu, gtk_menu_item_new_with_mnemonic("P_revious"),
 			G_CALLBACK(on_prev_activate), proxy);
-	g_signal_connect((gpointer) quit_menu_item, "activate",
-			G_CALLBACK(on_quit_activate), client_window);
+	append_item(popup_menu, gtk_separator_menu_item_new(), NULL, NULL);
+	tray->shuffle_item = append_item(popup_menu,
+			gtk_check_menu_item_new_with_mnemonic("S_huffle"),
+			G_CALLBACK(on_shuffle_toggled), proxy);
+	tray->loop_item = append_item(popup_menu,
+			gtk_check_menu_item_new_with_mnemonic("Re_peat"),
+			G_CALLBACK(on_loop_toggled), proxy);
+	append_item(popup_menu, gtk_separator_menu_item_new(), NULL, NULL);
+	append_item(popup_menu, gtk_menu_item_new_with_mnemonic("_Quit"),
+			G_CALLBACK(on_quit_activate), tray->client);
 
-	gtk_widget_show_all(GTK_WIDGET(popup_menu));
+	gtk_widget_show_all(popup_menu);
+	tray->menu = popup_menu;
+	update_popup_menu(tray, PROXY_CHANGED_METADATA | PROXY_CHANGED_STATE);
 
-	return GTK_MENU(popup_menu);
+	return popup_menu;
 }
 
 
-/* Find a suitable icon */
-static const gchar *lookup_icon(void)
+/* Show the icon variant for the playback status */
+static void update_icon(tray_icon_t *tray)
 {
-	GtkIconTheme *theme = gtk_icon_theme_get_default();
-	static const gchar *icon_name[] = {
-		"spotify-indicator",
-		"spotify",
-		"spotify-client",
-		NULL
-	};
-	guint i;
+	GdkPixbuf *pixbuf = icon_atlas_get(tray->icon_atlas,
+			tray->proxy->state.status);
 
-	for (i = 0; icon_name[i] != NULL; i++)
-		if (gtk_icon_theme_has_icon(theme, icon_name[i])) {
-			g_debug("Found icon: %s", icon_name[i]);
-			return icon_name[i];
-		}
-	g_critical("Could not find any suitable icon file");
+	tray->icon_status = tray->proxy->state.status;
+	if (pixbuf)
+		gtk_status_icon_set_from_pixbuf(tray->status_icon, pixbuf);
+}
+
+/* The tray size changed: render all the icon variants at the new size */
+static gboolean on_size_changed(GtkStatusIcon *status_icon, gint size,
+		gpointer user_data)
+{
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
 
-	return NULL;
+	if (!icon_atlas_render(tray->icon_atlas, size))
+		return FALSE;
+	update_icon(tray);
+
+	return TRUE;
+}
+
+static void on_icon_theme_changed(GtkIconTheme *theme, gpointer user_data)
+{
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
+
+	on_size_changed(tray->status_icon,
+			gtk_status_icon_get_size(tray->status_icon), tray);
+}
+
+/* Player properties changed: render the tooltip and start loading the
+ * album art for a new track, switch the icon on a playback status
+ * change and update the menu. */
+static void on_proxy_changed(proxy_t *proxy, guint changes,
+		gpointer user_data)
+{
+	tray_icon_t *tray = TRAY_ICON_T(user_data);
+
+	if ((changes & PROXY_CHANGED_METADATA) && proxy->metadata) {
+		g_strfreev(proxy->metadata->tooltip_markup);
+		proxy->metadata->tooltip_markup =
+			tooltip_format_render(tray->tooltip_format, proxy->metadata);
+		art_cache_fetch(tray->art, proxy->metadata->art_url);
+	}
+	if ((changes & PROXY_CHANGED_STATE) &&
+			(proxy->state.status != tray->icon_status))
+		update_icon(tray);
+	update_popup_menu(tray, changes);
 }
 
 /* Creates a new tray icon: assumes the Spotify client is properly installed
- * and uses its icon. Installs the popup_menu as the right-click menu and
- * lets left click to show/hide the Spotify cient window. */
-void new_tray_icon(proxy_t *proxy, GdkWindow *client_window,
-		const gchar *icon_file)
+ * and uses its icon. Shows the popup menu on right-click and lets left
+ * click to show/hide the Spotify cient window. */
+void new_tray_icon(proxy_t *proxy, win_client_t *client,
+		const gchar *icon_file, tray_scroll_mode_t scroll_mode,
+		const gchar *tooltip_format)
 {
 	GtkStatusIcon *tray_icon = gtk_status_icon_new();
-
-	if (!icon_file)
-		gtk_status_icon_set_from_icon_name(tray_icon, lookup_icon());
-	else
+	tray_icon_t *tray = g_malloc0(sizeof(tray_icon_t));
+
+	tray->proxy = proxy;
+	tray->client = client;
+	tray->scroll_mode = scroll_mode;
+	tray->burst_mode = scroll_mode;
+	tray->tooltip_format = tooltip_format_new(tooltip_format ?
+			tooltip_format : TOOLTIP_DEFAULT_FORMAT);
+	tray->art = art_cache_new(TOOLTIP_ART_SIZE);
+	tray->status_icon = tray_icon;
+	tray->icon_atlas = icon_atlas_new(icon_file);
+	on_proxy_changed(proxy, PROXY_CHANGED_METADATA, tray);
+	proxy_add_changed_func(proxy, on_proxy_changed, tray);
+
+	/* Shown until the tray tells the size and the atlas gets rendered */
+	if (!icon_file) {
+		gtk_status_icon_set_from_icon_name(tray_icon,
+				icon_atlas_lookup_icon());
+		g_signal_connect((gpointer) gtk_icon_theme_get_default(), "changed",
+			G_CALLBACK(on_icon_theme_changed), tray);
+	} else {
 		gtk_status_icon_set_from_file(tray_icon, icon_file);
+	}
+	g_signal_connect((gpointer) tray_icon, "size-changed",
+		G_CALLBACK(on_size_changed), tray);
 	gtk_status_icon_set_has_tooltip(tray_icon, TRUE);
 	gtk_status_icon_set_visible(tray_icon, TRUE);
 	g_signal_connect((gpointer) tray_icon, "popup-menu",
-		G_CALLBACK(on_popup), new_popup_menu(proxy, client_window));
+		G_CALLBACK(on_popup), tray);
 	g_signal_connect((gpointer) tray_icon, "activate",
-		G_CALLBACK(on_activate), client_window);
+		G_CALLBACK(on_activate), client);
 	g_signal_connect((gpointer) tray_icon, "button-release-event",
 		G_CALLBACK(on_button_release), proxy);
 	g_signal_connect((gpointer) tray_icon, "scroll-event",
-		G_CALLBACK(on_scroll), proxy);
+		G_CALLBACK(on_scroll), tray);
 	g_signal_connect((gpointer) tray_icon, "query-tooltip",
-		G_CALLBACK(on_tooltip_query), proxy);
+		G_CALLBACK(on_tooltip_query), tray);
 }
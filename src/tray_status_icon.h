@@ -1,7 +1,18 @@
 #ifndef _TRAY_STATUS_ICON_H
 #define _TRAY_STATUS_ICON_H
 
-void new_tray_icon(proxy_t *proxy, GdkWindow *client_window,
-		const gchar *icon_file);
+/* What the mouse wheel does without modifiers; Shift always seeks and Ctrl
+ * always changes the volume. */
+enum _tray_scroll_mode_e {
+	TRAY_SCROLL_TRACK,
+	TRAY_SCROLL_SEEK,
+	TRAY_SCROLL_VOLUME
+};
+
+typedef enum _tray_scroll_mode_e tray_scroll_mode_t;
+
+void new_tray_icon(proxy_t *proxy, win_client_t *client,
+		const gchar *icon_file, tray_scroll_mode_t scroll_mode,
+		const gchar *tooltip_format);
 
 #endif
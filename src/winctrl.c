@@ -2,91 +2,139 @@
 #include "../config.h"
 #endif
 
+#include <stdlib.h>
+#include <string.h>
 #include <X11/Xlib.h>
-#include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 #include "winctrl.h"
+#include "stats.h"
 
 #define SPOTIFY_WM_CLASS "spotify"
+#define WM_STATE_MAX_ATOMS 32 /* read from _NET_WM_STATE */
+#define ACTIVE_WINDOW_SOURCE_PAGER 2 /* _NET_ACTIVE_WINDOW source indication */
 
-/* Helper function to retrieve a X11 window property: display is the display
- * of the window win, prop is the requested property of type req_type. The
- * result should be cast to the desired type and its length is stored at the
- * lenght pointer. */
-static unsigned char *get_x_property(Display *display, Window win, Atom prop,
-		Atom req_type, unsigned long *length)
-{
-	int form;
-	unsigned long remaining;
-	Atom type;
-	unsigned char *result;
-
-	if (XGetWindowProperty(
-				display,
-				win,
-				prop,
-				0, 1024,
-				False,
-				req_type,
-				&type,
-				&form,
-				length,
-				&remaining,
-				&result) != Success) {
-		g_critical("Failed to list the display windows");
-		return NULL;
-	}
-	return result;
-}
-
-/* For the given X11 window on given display, find its WM_CLASS property and
- * return true if it corresponds to the Spotify client application. */
-static gboolean is_spotify_window(Display *display, Window win)
-{
-	unsigned char *class;
-	unsigned long length;
-	gboolean ret = FALSE;
-
-	Atom wm_class_prop =
-		gdk_x11_get_xatom_by_name_for_display(gdk_x11_lookup_xdisplay(display),
-				"WM_CLASS");
-	class = get_x_property(display,
-			win,
-			wm_class_prop,
-			XA_STRING,
-			&length);
-	if (length > 0) {
-		class[length - 1] = '\0';
-		ret = strlen((char *)class) == strlen(SPOTIFY_WM_CLASS) &&
-			(strncmp((char *)class, SPOTIFY_WM_CLASS, strlen(SPOTIFY_WM_CLASS)) == 0);
-		XFree(class);
+struct _winctrl_watch_s {
+	GdkWindow *root;
+	Atom client_list_prop;
+	winctrl_client_list_func_t func;
+	gpointer user_data;
+};
+
+/* Last known state of the client window. It's kept up to date from the
+ * window's StructureNotify and PropertyNotify events, so the actions need
+ * not ask the server (nor trust the state GDK guesses for foreign
+ * windows). */
+struct _winctrl_state_s {
+	xcb_window_t window; /* XCB_WINDOW_NONE if not tracked */
+	gboolean mapped;
+	gboolean hidden; /* minimized: _NET_WM_STATE_HIDDEN */
+	gboolean wm_state_pending; /* a _NET_WM_STATE reply is to be read */
+	xcb_get_property_cookie_t wm_state_cookie;
+};
+
+typedef struct _winctrl_state_s winctrl_state_t;
+
+enum _winctrl_action_e {
+	WINCTRL_TOGGLE,
+	WINCTRL_RAISE,
+	WINCTRL_HIDE
+};
+
+typedef enum _winctrl_action_e winctrl_action_t;
+
+/* Atoms not predefined by the protocol, interned once for all the scans. */
+static xcb_atom_t net_client_list_atom = XCB_ATOM_NONE;
+static xcb_atom_t net_wm_pid_atom = XCB_ATOM_NONE;
+static xcb_atom_t net_wm_state_atom = XCB_ATOM_NONE;
+static xcb_atom_t net_wm_state_hidden_atom = XCB_ATOM_NONE;
+static xcb_atom_t net_active_window_atom = XCB_ATOM_NONE;
+
+static winctrl_state_t client_state = { XCB_WINDOW_NONE, FALSE, FALSE, FALSE };
+static gboolean client_filter_added = FALSE;
+
+static xcb_atom_t intern_atom_reply(xcb_connection_t *conn,
+		xcb_intern_atom_cookie_t cookie)
+{
+	xcb_intern_atom_reply_t *reply;
+	xcb_atom_t atom = XCB_ATOM_NONE;
+
+	if ((reply = xcb_intern_atom_reply(conn, cookie, NULL))) {
+		atom = reply->atom;
+		free(reply);
 	}
-	return ret;
-}
-
-
-/* For the given X11 window on given display, get its PID */
-static unsigned long get_window_pid(Display *display, Window win)
-{
-	unsigned char *pid_prop_val;
-	unsigned long length;
-	unsigned long pid = 0UL;
-
-	Atom pid_prop =
-		gdk_x11_get_xatom_by_name_for_display(gdk_x11_lookup_xdisplay(display),
-				"_NET_WM_PID");
-	pid_prop_val = get_x_property(display,
-			win,
-			pid_prop,
-			XA_CARDINAL,
-			&length);
-	if ((length > 0) && pid_prop_val) {
-		pid = pid_prop_val[0]
-			+ (pid_prop_val[1]<<8)
-			+ (pid_prop_val[2]<<16)
-			+ (pid_prop_val[3]<<24);
-		g_debug("Class pid %lu", pid);
+
+	return atom;
+}
+
+static void intern_atoms(xcb_connection_t *conn)
+{
+	xcb_intern_atom_cookie_t client_list_cookie, pid_cookie;
+	xcb_intern_atom_cookie_t state_cookie, hidden_cookie, active_cookie;
+
+	if (net_client_list_atom != XCB_ATOM_NONE)
+		return;
+	client_list_cookie = xcb_intern_atom(conn, 0,
+			strlen("_NET_CLIENT_LIST"), "_NET_CLIENT_LIST");
+	pid_cookie = xcb_intern_atom(conn, 0,
+			strlen("_NET_WM_PID"), "_NET_WM_PID");
+	state_cookie = xcb_intern_atom(conn, 0,
+			strlen("_NET_WM_STATE"), "_NET_WM_STATE");
+	hidden_cookie = xcb_intern_atom(conn, 0,
+			strlen("_NET_WM_STATE_HIDDEN"), "_NET_WM_STATE_HIDDEN");
+	active_cookie = xcb_intern_atom(conn, 0,
+			strlen("_NET_ACTIVE_WINDOW"), "_NET_ACTIVE_WINDOW");
+	net_client_list_atom = intern_atom_reply(conn, client_list_cookie);
+	net_wm_pid_atom = intern_atom_reply(conn, pid_cookie);
+	net_wm_state_atom = intern_atom_reply(conn, state_cookie);
+	net_wm_state_hidden_atom = intern_atom_reply(conn, hidden_cookie);
+	net_active_window_atom = intern_atom_reply(conn, active_cookie);
+	stats_add(STATS_XCB_REQUESTS, 5);
+	stats_inc(STATS_X_ROUND_TRIPS);
+}
+
+/* Collect the reply for a property request, errors (like a window that
+ * disappeared in the meantime) just yield NULL. */
+static xcb_get_property_reply_t *get_property_reply(xcb_connection_t *conn,
+		xcb_get_property_cookie_t cookie)
+{
+	xcb_generic_error_t *error = NULL;
+	xcb_get_property_reply_t *reply;
+
+	reply = xcb_get_property_reply(conn, cookie, &error);
+	free(error);
+
+	return reply;
+}
+
+/* Return true if the WM_CLASS property value corresponds to the Spotify
+ * client application: the first string in the property is the instance
+ * name. */
+static gboolean is_spotify_class(xcb_get_property_reply_t *class_reply)
+{
+	const char *class;
+	int length;
+
+	if (!class_reply || (class_reply->format != 8))
+		return FALSE;
+	class = xcb_get_property_value(class_reply);
+	length = xcb_get_property_value_length(class_reply);
+
+	return (strnlen(class, length) == strlen(SPOTIFY_WM_CLASS)) &&
+		(strncmp(class, SPOTIFY_WM_CLASS, strlen(SPOTIFY_WM_CLASS)) == 0);
+}
+
+/* Get the PID from the _NET_WM_PID property value. */
+static GPid get_window_pid(xcb_get_property_reply_t *pid_reply)
+{
+	GPid pid = 0;
+
+	if (pid_reply && (pid_reply->format == 32) &&
+			(xcb_get_property_value_length(pid_reply) >= 4)) {
+		pid = *(uint32_t *)xcb_get_property_value(pid_reply);
+		g_debug("Class pid %d", pid);
 	}
 
 	return pid;
@@ -94,33 +142,330 @@ static unsigned long get_window_pid(Display *display, Window win)
 
 
 /* Use X11 to find the Spotify client window and get a GDK window for it.
- * Returns the GdkWindow if found, NULL otherwise. */
+ * The WM_CLASS and _NET_WM_PID requests for all the managed windows are
+ * sent in one batch before any reply is read, so the scan costs one round
+ * trip for the window list and one for the properties regardless of the
+ * number of windows. */
 void winctrl_get_client(win_client_t *win_client)
 {
-	Atom win_list_prop;
 	Display *display;
-	unsigned long length, i;
-	Window *win_list;
+	xcb_connection_t *conn;
+	xcb_get_property_cookie_t list_cookie;
+	xcb_get_property_cookie_t *class_cookies, *pid_cookies;
+	xcb_get_property_reply_t *list_reply, *class_reply, *pid_reply;
+	xcb_window_t *win_list;
+	int length, i;
+	gboolean found = FALSE;
 
 	display = gdk_x11_get_default_xdisplay();
+	conn = XGetXCBConnection(display);
+	intern_atoms(conn);
+	/* Keep the ordering with whatever Xlib has queued so far. */
+	XFlush(display);
 
-	/* List all the windows the window manager knows abouti. */
-	win_list_prop =
-		gdk_x11_get_xatom_by_name_for_display(gdk_x11_lookup_xdisplay(display),
-				"_NET_CLIENT_LIST");
-	win_list = (Window *)get_x_property(display,
+	/* List all the windows the window manager knows about. */
+	list_cookie = xcb_get_property(conn, 0,
 			gdk_x11_get_default_root_xwindow(),
-			win_list_prop,
-			XA_WINDOW,
-			&length);
+			net_client_list_atom,
+			XCB_ATOM_WINDOW,
+			0, 1024);
+	list_reply = get_property_reply(conn, list_cookie);
+	stats_inc(STATS_XCB_REQUESTS);
+	stats_inc(STATS_X_ROUND_TRIPS);
+	if (!list_reply) {
+		g_critical("Failed to list the display windows");
+		return;
+	}
+	win_list = xcb_get_property_value(list_reply);
+	length = xcb_get_property_value_length(list_reply) / sizeof(xcb_window_t);
+
+	class_cookies = g_new(xcb_get_property_cookie_t, length);
+	pid_cookies = g_new(xcb_get_property_cookie_t, length);
+	for (i = 0; i < length; i++) {
+		class_cookies[i] = xcb_get_property(conn, 0, win_list[i],
+				XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, 1024);
+		pid_cookies[i] = xcb_get_property(conn, 0, win_list[i],
+				net_wm_pid_atom, XCB_ATOM_CARDINAL, 0, 1);
+	}
+	xcb_flush(conn);
+	stats_add(STATS_XCB_REQUESTS, 2 * length);
+	if (length > 0)
+		stats_inc(STATS_X_ROUND_TRIPS);
 	/* Try to find the one with the WM_CLASS property corresponding
-	 * to the Spotify client. */
-	for (i = 0; i < length; i++)
-		if (is_spotify_window(display, win_list[i])) {
+	 * to the Spotify client; the replies past it are just dropped. */
+	for (i = 0; i < length; i++) {
+		if (found) {
+			xcb_discard_reply(conn, class_cookies[i].sequence);
+			xcb_discard_reply(conn, pid_cookies[i].sequence);
+			continue;
+		}
+		class_reply = get_property_reply(conn, class_cookies[i]);
+		pid_reply = get_property_reply(conn, pid_cookies[i]);
+		if (is_spotify_class(class_reply)) {
 			win_client->window = gdk_x11_window_foreign_new_for_display(
 					gdk_x11_lookup_xdisplay(display), win_list[i]);
-			win_client->pid = get_window_pid(display, win_list[i]);
-			break;
+			win_client->pid = get_window_pid(pid_reply);
+			found = TRUE;
+		}
+		free(class_reply);
+		free(pid_reply);
+	}
+	g_free(class_cookies);
+	g_free(pid_cookies);
+	free(list_reply);
+}
+
+
+/* Root window event filter: let the watcher know the window manager has
+ * updated the list of the managed windows. */
+static GdkFilterReturn on_root_event(GdkXEvent *gdk_xevent, GdkEvent *event,
+		gpointer user_data)
+{
+	XEvent *xevent = (XEvent *)gdk_xevent;
+	winctrl_watch_t *watch = user_data;
+
+	if ((xevent->type == PropertyNotify) &&
+			(xevent->xproperty.atom == watch->client_list_prop))
+		watch->func(watch->user_data);
+
+	return GDK_FILTER_CONTINUE;
+}
+
+
+/* Call func every time the _NET_CLIENT_LIST property of the root window
+ * changes, i.e. a window gets managed or unmanaged. */
+winctrl_watch_t *winctrl_watch_client_list(winctrl_client_list_func_t func,
+		gpointer user_data)
+{
+	winctrl_watch_t *watch = g_malloc(sizeof(winctrl_watch_t));
+
+	watch->root = gdk_get_default_root_window();
+	watch->client_list_prop = gdk_x11_get_xatom_by_name_for_display(
+			gdk_window_get_display(watch->root), "_NET_CLIENT_LIST");
+	watch->func = func;
+	watch->user_data = user_data;
+	gdk_window_set_events(watch->root,
+			gdk_window_get_events(watch->root) | GDK_PROPERTY_CHANGE_MASK);
+	gdk_window_add_filter(watch->root, on_root_event, watch);
+
+	return watch;
+}
+
+void winctrl_unwatch_client_list(winctrl_watch_t *watch)
+{
+	if (!watch)
+		return;
+	gdk_window_remove_filter(watch->root, on_root_event, watch);
+	g_free(watch);
+}
+
+
+static xcb_connection_t *get_connection(void)
+{
+	return XGetXCBConnection(gdk_x11_get_default_xdisplay());
+}
+
+/* Ask for the _NET_WM_STATE of the client window; the reply is read only
+ * when the state is needed, by then it has normally arrived. */
+static void request_wm_state(xcb_connection_t *conn)
+{
+	if (client_state.wm_state_pending)
+		xcb_discard_reply(conn, client_state.wm_state_cookie.sequence);
+	client_state.wm_state_cookie = xcb_get_property(conn, 0,
+			client_state.window, net_wm_state_atom, XCB_ATOM_ATOM,
+			0, WM_STATE_MAX_ATOMS);
+	client_state.wm_state_pending = TRUE;
+	stats_inc(STATS_XCB_REQUESTS);
+}
+
+static gboolean has_atom(xcb_get_property_reply_t *reply, xcb_atom_t atom)
+{
+	xcb_atom_t *atoms;
+	int length, i;
+
+	if (!reply || (reply->format != 32))
+		return FALSE;
+	atoms = xcb_get_property_value(reply);
+	length = xcb_get_property_value_length(reply) / sizeof(xcb_atom_t);
+	for (i = 0; i < length; i++)
+		if (atoms[i] == atom)
+			return TRUE;
+
+	return FALSE;
+}
+
+static void read_wm_state(xcb_connection_t *conn)
+{
+	xcb_get_property_reply_t *reply;
+
+	if (!client_state.wm_state_pending)
+		return;
+	client_state.wm_state_pending = FALSE;
+	reply = get_property_reply(conn, client_state.wm_state_cookie);
+	client_state.hidden = has_atom(reply, net_wm_state_hidden_atom);
+	free(reply);
+}
+
+static void untrack(xcb_connection_t *conn)
+{
+	if (client_state.wm_state_pending)
+		xcb_discard_reply(conn, client_state.wm_state_cookie.sequence);
+	client_state.wm_state_pending = FALSE;
+	client_state.window = XCB_WINDOW_NONE;
+}
+
+/* Keeps the state cache up to date; sees the events for all the windows. */
+static GdkFilterReturn on_client_event(GdkXEvent *gdk_xevent, GdkEvent *event,
+		gpointer user_data)
+{
+	XEvent *xevent = (XEvent *)gdk_xevent;
+	xcb_connection_t *conn = get_connection();
+
+	if ((client_state.window == XCB_WINDOW_NONE) ||
+			(xevent->xany.window != client_state.window))
+		return GDK_FILTER_CONTINUE;
+	switch (xevent->type) {
+	case MapNotify:
+		client_state.mapped = TRUE;
+		break;
+	case UnmapNotify:
+		client_state.mapped = FALSE;
+		break;
+	case DestroyNotify:
+		untrack(conn);
+		break;
+	case PropertyNotify:
+		if (xevent->xproperty.atom == net_wm_state_atom) {
+			request_wm_state(conn);
+			xcb_flush(conn);
 		}
-	XFree(win_list);
+		break;
+	}
+
+	return GDK_FILTER_CONTINUE;
+}
+
+/* Start following the window state: select its events first, then read
+ * the current state, in one round trip. The events are selected through
+ * GDK like for the root window: the mask is the tray's own on that window
+ * (other clients keep theirs) and GDK knows of it, so nothing it selected
+ * before is dropped. Xlib sends it, within the caller's error trap. */
+static void track(xcb_connection_t *conn, GdkWindow *window)
+{
+	xcb_get_window_attributes_cookie_t attr_cookie;
+	xcb_get_window_attributes_reply_t *attr;
+
+	if (!client_filter_added) {
+		gdk_window_add_filter(NULL, on_client_event, NULL);
+		client_filter_added = TRUE;
+	}
+	intern_atoms(conn);
+	untrack(conn);
+	client_state.window = GDK_WINDOW_XID(window);
+	gdk_window_set_events(window, gdk_window_get_events(window) |
+			GDK_STRUCTURE_MASK | GDK_PROPERTY_CHANGE_MASK);
+	/* Keep the ordering with whatever Xlib has queued so far. */
+	XFlush(gdk_x11_get_default_xdisplay());
+	attr_cookie = xcb_get_window_attributes(conn, client_state.window);
+	stats_inc(STATS_XCB_REQUESTS);
+	request_wm_state(conn);
+	attr = xcb_get_window_attributes_reply(conn, attr_cookie, NULL);
+	client_state.mapped = attr && (attr->map_state != XCB_MAP_STATE_UNMAPPED);
+	free(attr);
+	read_wm_state(conn);
+	stats_inc(STATS_X_ROUND_TRIPS);
+}
+
+/* Make sure the cache follows the current client window; FALSE if there
+ * is none (the client is being restarted). */
+static gboolean bind_client(xcb_connection_t *conn, win_client_t *client)
+{
+	if (!client->window)
+		return FALSE;
+	if (GDK_WINDOW_XID(client->window) != client_state.window)
+		track(conn, client->window);
+	read_wm_state(conn);
+
+	return TRUE;
+}
+
+/* Start tracking the client window state ahead of the first action */
+void winctrl_track_client(win_client_t *client)
+{
+	GdkDisplay *display = gdk_display_get_default();
+
+	gdk_x11_display_error_trap_push(display);
+	bind_client(get_connection(), client);
+	gdk_x11_display_error_trap_pop_ignored(display);
+}
+
+/* Map, raise and un-minimize the window as needed. The requests go
+ * through Xlib, the X error traps of GDK only cover what Xlib sends. */
+static void raise_client(Display *display)
+{
+	XEvent activate;
+
+	if (!client_state.mapped)
+		XMapWindow(display, client_state.window);
+	XRaiseWindow(display, client_state.window);
+	if (client_state.hidden) {
+		/* Some window managers keep minimized windows mapped */
+		memset(&activate, 0, sizeof(activate));
+		activate.xclient.type = ClientMessage;
+		activate.xclient.window = client_state.window;
+		activate.xclient.message_type = net_active_window_atom;
+		activate.xclient.format = 32;
+		activate.xclient.data.l[0] = ACTIVE_WINDOW_SOURCE_PAGER;
+		activate.xclient.data.l[1] = CurrentTime;
+		XSendEvent(display, DefaultRootWindow(display), False,
+				SubstructureRedirectMask | SubstructureNotifyMask,
+				&activate);
+	}
+	client_state.mapped = TRUE;
+	client_state.hidden = FALSE;
+}
+
+/* Unmap the window and let the window manager know it's withdrawn */
+static void hide_client(Display *display)
+{
+	if (!client_state.mapped)
+		return;
+	XWithdrawWindow(display, client_state.window, DefaultScreen(display));
+	client_state.mapped = FALSE;
+}
+
+static void client_action(win_client_t *client, winctrl_action_t action)
+{
+	GdkDisplay *display = gdk_display_get_default();
+	Display *xdisplay = gdk_x11_get_default_xdisplay();
+
+	/* The window may be gone already */
+	gdk_x11_display_error_trap_push(display);
+	if (bind_client(get_connection(), client)) {
+		if ((action == WINCTRL_HIDE) || ((action == WINCTRL_TOGGLE) &&
+					client_state.mapped && !client_state.hidden))
+			hide_client(xdisplay);
+		else
+			raise_client(xdisplay);
+		XFlush(xdisplay);
+	}
+	gdk_x11_display_error_trap_pop_ignored(display);
+}
+
+/* The window actions shared by the tray icon and the D-Bus interface. The
+ * decision is taken from the cached state and the requests go out with a
+ * single flush; nothing is done while there's no client window. */
+void winctrl_toggle(win_client_t *client)
+{
+	client_action(client, WINCTRL_TOGGLE);
+}
+
+void winctrl_raise(win_client_t *client)
+{
+	client_action(client, WINCTRL_RAISE);
+}
+
+void winctrl_hide(win_client_t *client)
+{
+	client_action(client, WINCTRL_HIDE);
 }
@@ -8,6 +8,16 @@ struct _win_client_s {
 
 typedef struct _win_client_s win_client_t;
 
+typedef void (*winctrl_client_list_func_t)(gpointer user_data);
+typedef struct _winctrl_watch_s winctrl_watch_t;
+
 void winctrl_get_client(win_client_t *win_client);
+winctrl_watch_t *winctrl_watch_client_list(winctrl_client_list_func_t func,
+		gpointer user_data);
+void winctrl_unwatch_client_list(winctrl_watch_t *watch);
+void winctrl_track_client(win_client_t *client);
+void winctrl_toggle(win_client_t *client);
+void winctrl_raise(win_client_t *client);
+void winctrl_hide(win_client_t *client);
 
 #endif